@@ -0,0 +1,108 @@
+#include "batch.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+#include "headless.hpp"
+#include "png.hpp"
+#include "quad.hpp"
+#include "resources.hpp"
+#include "scene.hpp"
+#include "shader.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Interval of checking whether the parse of the next model finished
+const std::chrono::milliseconds LOAD_POLL_INTERVAL{1};
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Returns the path of the image of the model, mirroring its place under the model directory
+fs::path image_path(const fs::path& output_dir, const fs::path& model_dir,
+                    const std::string& model_path) {
+    std::error_code ec;
+    fs::path relative = fs::relative(model_path, model_dir, ec);
+    if (ec || relative.empty() || *relative.begin() == "..") {
+        relative = fs::path(model_path).filename();
+    }
+    return (output_dir / relative).replace_extension(".png");
+}
+} // namespace
+
+void render_batch(const fs::path& model_dir, const std::vector<std::string>& model_paths,
+                  ModelOptions model_options, const BatchOptions& options) {
+    // Images are rendered at full detail from complete meshes
+    model_options.lod = false;
+    model_options.stream = false;
+
+    // Created first, so that it is destroyed after everything holding GL objects
+    HeadlessContext context{options.width, options.height};
+    std::cerr << "Rendering " << model_paths.size() << " models offscreen with "
+              << context.renderer() << "\n";
+
+    Shader shader{context, resources::SHADER_VS, resources::SHADER_FS};
+    ModelList models{model_paths, model_options};
+
+    Scene scene{std::move(shader), {0.2f, 0.2f, 0.2f}};
+    scene.add_layer("models");
+    scene.add("models", std::make_unique<ModelList>(models));
+    scene.add_layer("floor", {false, false});
+    scene.add("floor", std::make_unique<Quad>());
+
+    Mvp mvp{options.width, options.height};
+    mvp.update_eyepos(options.eyepos - Mvp::DEFAULT_EYEPOS);
+    mvp.update_center(options.center - Mvp::DEFAULT_CENTER);
+    if (options.orthogonal) {
+        mvp.set_project_mode(Mvp::ProjectMode::Orthogonal);
+    }
+
+    const auto start = Clock::now();
+    // Time spent drawing, reading back and writing, as opposed to waiting for parses
+    double render_seconds = 0;
+    size_t written = 0;
+    for (size_t i = 0; i < model_paths.size(); i++) {
+        if (i > 0) {
+            // Also prefetches the model after it, which is parsed while this one is rendered
+            models.next_model();
+        }
+        const Model& model = models.current();
+        while (model.loading()) {
+            std::this_thread::sleep_for(LOAD_POLL_INTERVAL);
+        }
+
+        const auto render_start = Clock::now();
+        // The first draw after the parse uploads the model
+        scene.render(context, mvp);
+        if (model.stats().triangle_count == 0) {
+            std::cerr << "Skipped " << model.path() << ", which failed to load\n";
+            continue;
+        }
+
+        const fs::path path = image_path(options.output_dir, model_dir, model.path());
+        try {
+            fs::create_directories(path.parent_path());
+            write_png(path, static_cast<size_t>(options.width),
+                      static_cast<size_t>(options.height), context.read_pixels());
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to write image of " << model.path() << ":\n" << e.what() << "\n";
+            continue;
+        }
+        render_seconds += seconds_since(render_start);
+        written++;
+        std::cerr << "[" << i + 1 << "/" << model_paths.size() << "] " << path.string() << "\n";
+    }
+
+    const double total_seconds = seconds_since(start);
+    std::cerr << "Rendered " << written << " images in " << total_seconds << " s, "
+              << (total_seconds > 0 ? written / total_seconds : 0) << " images/s ("
+              << (render_seconds > 0 ? written / render_seconds : 0)
+              << " images/s without waiting for loads)\n";
+}
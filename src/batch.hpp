@@ -0,0 +1,36 @@
+#ifndef BATCH_HPP_
+#define BATCH_HPP_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+#include "transform/mvp.hpp"
+
+// Options of rendering models to images without a window.
+struct BatchOptions {
+    // Directory the images are written to.  Models are shown in a window instead if empty.
+    std::string output_dir;
+
+    // Size of the images in pixels
+    int width = 800;
+    int height = 600;
+
+    // Camera every image is rendered with
+    Vector3 eyepos = Mvp::DEFAULT_EYEPOS;
+    Vector3 center = Mvp::DEFAULT_CENTER;
+    bool orthogonal = false;
+};
+
+// Renders each model, with the floor below it, to a PNG image in an offscreen context.
+// The images are written under the output directory, at the paths of the models relative to
+// model_dir with the extension replaced.
+// Models that fail to load are skipped.  Prints progress and the number of images rendered per
+// second to standard error.
+// Throws if the offscreen context cannot be created.
+void render_batch(const std::filesystem::path& model_dir,
+                  const std::vector<std::string>& model_paths, ModelOptions model_options,
+                  const BatchOptions& options);
+
+#endif
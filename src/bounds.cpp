@@ -0,0 +1,276 @@
+#include "bounds.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "threadpool.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BOUNDS_SSE
+#include <immintrin.h>
+// Runtime dispatch to AVX2 relies on the GCC / Clang target attribute
+#if defined(__GNUC__)
+#define BOUNDS_AVX2
+#endif
+#endif
+
+namespace {
+// Inputs smaller than this per thread are not worth splitting further
+const size_t MIN_POINTS_PER_THREAD = 1 << 18;
+
+enum class Kernel { Scalar, Sse, Avx2 };
+
+Kernel detect_kernel() {
+#if defined(BOUNDS_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel::Avx2;
+    }
+#endif
+#if defined(BOUNDS_SSE)
+    return Kernel::Sse;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+Kernel best_kernel() {
+    static const Kernel kernel = detect_kernel();
+    return kernel;
+}
+
+const char* kernel_name(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::Sse:
+        return "sse";
+    case Kernel::Avx2:
+        return "avx2";
+    }
+    return "";
+}
+
+Bounds empty_bounds() {
+    const float inf = std::numeric_limits<float>::infinity();
+    return Bounds{{inf, inf, inf}, {-inf, -inf, -inf}};
+}
+
+void merge(Bounds& into, const Bounds& other) {
+    for (int axis = 0; axis < 3; axis++) {
+        into.min[axis] = std::min(into.min[axis], other.min[axis]);
+        into.max[axis] = std::max(into.max[axis], other.max[axis]);
+    }
+}
+
+// Folds SIMD accumulators into bounds.
+// The accumulators hold 3 registers of width lanes each, loaded from consecutive xyz triples, so
+// the axis of lane j of the flattened registers is j % 3.
+void fold(const float* mins, const float* maxs, size_t width, Bounds& bounds) {
+    for (size_t j = 0; j < 3 * width; j++) {
+        bounds.min[j % 3] = std::min(bounds.min[j % 3], mins[j]);
+        bounds.max[j % 3] = std::max(bounds.max[j % 3], maxs[j]);
+    }
+}
+
+void bounds_scalar(const float* xyz, size_t count, Bounds& bounds) {
+    for (size_t i = 0; i < count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            bounds.min[axis] = std::min(bounds.min[axis], xyz[3 * i + axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], xyz[3 * i + axis]);
+        }
+    }
+}
+
+void transform_scalar(float* xyz, size_t count, const float* center, float scale) {
+    for (size_t i = 0; i < count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            xyz[3 * i + axis] = (xyz[3 * i + axis] - center[axis]) * scale;
+        }
+    }
+}
+
+#if defined(BOUNDS_SSE)
+// Processes 4 points (3 registers) per iteration
+void bounds_sse(const float* xyz, size_t count, Bounds& bounds) {
+    const size_t blocks = count / 4;
+    __m128 mins[3], maxs[3];
+    for (int k = 0; k < 3; k++) {
+        mins[k] = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        maxs[k] = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        for (int k = 0; k < 3; k++) {
+            const __m128 v = _mm_loadu_ps(xyz + 12 * b + 4 * k);
+            mins[k] = _mm_min_ps(mins[k], v);
+            maxs[k] = _mm_max_ps(maxs[k], v);
+        }
+    }
+
+    float min_lanes[12], max_lanes[12];
+    for (int k = 0; k < 3; k++) {
+        _mm_storeu_ps(min_lanes + 4 * k, mins[k]);
+        _mm_storeu_ps(max_lanes + 4 * k, maxs[k]);
+    }
+    fold(min_lanes, max_lanes, 4, bounds);
+    bounds_scalar(xyz + 12 * blocks, count - 4 * blocks, bounds);
+}
+
+void transform_sse(float* xyz, size_t count, const float* center, float scale) {
+    const size_t blocks = count / 4;
+    __m128 centers[3];
+    for (int k = 0; k < 3; k++) {
+        centers[k] = _mm_setr_ps(center[(4 * k + 0) % 3], center[(4 * k + 1) % 3],
+                                 center[(4 * k + 2) % 3], center[(4 * k + 3) % 3]);
+    }
+    const __m128 scales = _mm_set1_ps(scale);
+    for (size_t b = 0; b < blocks; b++) {
+        for (int k = 0; k < 3; k++) {
+            float* p = xyz + 12 * b + 4 * k;
+            _mm_storeu_ps(p, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p), centers[k]), scales));
+        }
+    }
+    transform_scalar(xyz + 12 * blocks, count - 4 * blocks, center, scale);
+}
+#endif
+
+#if defined(BOUNDS_AVX2)
+// Processes 8 points (3 registers) per iteration
+__attribute__((target("avx2"))) void bounds_avx2(const float* xyz, size_t count,
+                                                 Bounds& bounds) {
+    const size_t blocks = count / 8;
+    __m256 mins[3], maxs[3];
+    for (int k = 0; k < 3; k++) {
+        mins[k] = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        maxs[k] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        for (int k = 0; k < 3; k++) {
+            const __m256 v = _mm256_loadu_ps(xyz + 24 * b + 8 * k);
+            mins[k] = _mm256_min_ps(mins[k], v);
+            maxs[k] = _mm256_max_ps(maxs[k], v);
+        }
+    }
+
+    float min_lanes[24], max_lanes[24];
+    for (int k = 0; k < 3; k++) {
+        _mm256_storeu_ps(min_lanes + 8 * k, mins[k]);
+        _mm256_storeu_ps(max_lanes + 8 * k, maxs[k]);
+    }
+    fold(min_lanes, max_lanes, 8, bounds);
+    bounds_scalar(xyz + 24 * blocks, count - 8 * blocks, bounds);
+}
+
+__attribute__((target("avx2"))) void transform_avx2(float* xyz, size_t count,
+                                                    const float* center, float scale) {
+    const size_t blocks = count / 8;
+    __m256 centers[3];
+    for (int k = 0; k < 3; k++) {
+        float lanes[8];
+        for (int i = 0; i < 8; i++) {
+            lanes[i] = center[(8 * k + i) % 3];
+        }
+        centers[k] = _mm256_loadu_ps(lanes);
+    }
+    const __m256 scales = _mm256_set1_ps(scale);
+    for (size_t b = 0; b < blocks; b++) {
+        for (int k = 0; k < 3; k++) {
+            float* p = xyz + 24 * b + 8 * k;
+            _mm256_storeu_ps(p,
+                             _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p), centers[k]), scales));
+        }
+    }
+    transform_scalar(xyz + 24 * blocks, count - 8 * blocks, center, scale);
+}
+#endif
+
+void bounds_kernel(Kernel kernel, const float* xyz, size_t count, Bounds& bounds) {
+    switch (kernel) {
+#if defined(BOUNDS_AVX2)
+    case Kernel::Avx2:
+        bounds_avx2(xyz, count, bounds);
+        return;
+#endif
+#if defined(BOUNDS_SSE)
+    case Kernel::Sse:
+        bounds_sse(xyz, count, bounds);
+        return;
+#endif
+    default:
+        bounds_scalar(xyz, count, bounds);
+    }
+}
+
+void transform_kernel(Kernel kernel, float* xyz, size_t count, const float* center, float scale) {
+    switch (kernel) {
+#if defined(BOUNDS_AVX2)
+    case Kernel::Avx2:
+        transform_avx2(xyz, count, center, scale);
+        return;
+#endif
+#if defined(BOUNDS_SSE)
+    case Kernel::Sse:
+        transform_sse(xyz, count, center, scale);
+        return;
+#endif
+    default:
+        transform_scalar(xyz, count, center, scale);
+    }
+}
+
+size_t thread_count_for(size_t count) {
+    const size_t hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    return std::clamp<size_t>(count / MIN_POINTS_PER_THREAD, 1, hardware);
+}
+} // namespace
+
+Bounds compute_bounds(const float* xyz, size_t count) {
+    const Kernel kernel = best_kernel();
+    const size_t threads = thread_count_for(count);
+    std::vector<Bounds> partial(threads, empty_bounds());
+    parallel_for(threads, [&](size_t t) {
+        const size_t begin = count * t / threads;
+        const size_t end = count * (t + 1) / threads;
+        bounds_kernel(kernel, xyz + 3 * begin, end - begin, partial[t]);
+    });
+
+    Bounds bounds = empty_bounds();
+    for (const auto& part : partial) {
+        merge(bounds, part);
+    }
+    return bounds;
+}
+
+void center_and_scale(float* xyz, size_t count, const Bounds& bounds) {
+    float center[3];
+    float extent = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        center[axis] = (bounds.min[axis] + bounds.max[axis]) / 2;
+        extent = std::max(extent, bounds.max[axis] - bounds.min[axis]);
+    }
+    // Leave the scale alone for degenerate models such as a single point
+    const float scale = extent > 0 ? 2 / extent : 1;
+
+    const Kernel kernel = best_kernel();
+    const size_t threads = thread_count_for(count);
+    parallel_for(threads, [&](size_t t) {
+        const size_t begin = count * t / threads;
+        const size_t end = count * (t + 1) / threads;
+        transform_kernel(kernel, xyz + 3 * begin, end - begin, center, scale);
+    });
+}
+
+NormalizeStats normalize_points(float* xyz, size_t count) {
+    const auto start = std::chrono::steady_clock::now();
+    if (count > 0) {
+        center_and_scale(xyz, count, compute_bounds(xyz, count));
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // One read for the bounds, one read and one write for the transform
+    const double bytes = static_cast<double>(count) * 3 * sizeof(float) * 3;
+    const double seconds = elapsed.count();
+    return NormalizeStats{seconds, seconds > 0 ? bytes / seconds : 0, kernel_name(best_kernel())};
+}
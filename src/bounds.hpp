@@ -0,0 +1,37 @@
+#ifndef BOUNDS_HPP_
+#define BOUNDS_HPP_
+
+#include <cstddef>
+
+using std::size_t;
+
+// Axis-aligned bounding box.
+struct Bounds {
+    float min[3];
+    float max[3];
+};
+
+// Timing of a normalize_points call.
+struct NormalizeStats {
+    double seconds;
+
+    // Bytes read and written by both passes, per second
+    double bytes_per_second;
+
+    // Name of the instruction set used, e.g. "avx2"
+    const char* kernel;
+};
+
+// Computes the bounds of count points stored as consecutive xyz triples.
+// Returns an empty box (min > max) if count is zero.
+Bounds compute_bounds(const float* xyz, size_t count);
+
+// Moves the center of bounds to the origin and scales uniformly so that the longest axis of bounds
+// spans [-1, 1].
+void center_and_scale(float* xyz, size_t count, const Bounds& bounds);
+
+// Runs compute_bounds and center_and_scale over the points.
+// Both passes are vectorized and split across threads for large inputs.
+NormalizeStats normalize_points(float* xyz, size_t count);
+
+#endif
@@ -0,0 +1,201 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BVH_SSE
+#include <immintrin.h>
+#endif
+
+namespace {
+// Subtrees with no more boxes than this are not split further
+const std::uint32_t NODE_WIDTH = 4;
+
+Bounds empty_bounds() {
+    const float inf = std::numeric_limits<float>::infinity();
+    return Bounds{{inf, inf, inf}, {-inf, -inf, -inf}};
+}
+
+void merge(Bounds& into, const Bounds& other) {
+    for (int axis = 0; axis < 3; axis++) {
+        into.min[axis] = std::min(into.min[axis], other.min[axis]);
+        into.max[axis] = std::max(into.max[axis], other.max[axis]);
+    }
+}
+
+float center(const Bounds& box, int axis) { return box.min[axis] + box.max[axis]; }
+
+// Splits the range of order at its middle along the longest axis of the box centers
+void split_half(const std::vector<Bounds>& boxes, std::uint32_t* first, std::uint32_t* last) {
+    Bounds centers = empty_bounds();
+    for (const std::uint32_t* it = first; it != last; ++it) {
+        for (int axis = 0; axis < 3; axis++) {
+            centers.min[axis] = std::min(centers.min[axis], center(boxes[*it], axis));
+            centers.max[axis] = std::max(centers.max[axis], center(boxes[*it], axis));
+        }
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (centers.max[a] - centers.min[a] > centers.max[axis] - centers.min[axis]) {
+            axis = a;
+        }
+    }
+    std::nth_element(first, first + (last - first) / 2, last,
+                     [&](std::uint32_t a, std::uint32_t b) {
+                         return center(boxes[a], axis) < center(boxes[b], axis);
+                     });
+}
+
+// Tests the child boxes of a node against the planes.  Sets bit i of outside if child i is
+// certainly outside the view volume, and of crossing if it may cross one of the planes.
+template <typename Node>
+void test_children(const Node& node, const CullView& view, int& outside, int& crossing) {
+#if defined(BVH_SSE)
+    __m128 out = _mm_setzero_ps();
+    __m128 cross = _mm_setzero_ps();
+    const __m128 zero = _mm_setzero_ps();
+    for (const auto& plane : view.planes) {
+        // The corner furthest along the normal, and the one furthest against it
+        __m128 far = _mm_set1_ps(plane[3]);
+        __m128 near = far;
+        for (int axis = 0; axis < 3; axis++) {
+            const __m128 n = _mm_set1_ps(plane[axis]);
+            const __m128 lo = _mm_loadu_ps(node.min[axis]);
+            const __m128 hi = _mm_loadu_ps(node.max[axis]);
+            far = _mm_add_ps(far, _mm_mul_ps(n, plane[axis] >= 0 ? hi : lo));
+            near = _mm_add_ps(near, _mm_mul_ps(n, plane[axis] >= 0 ? lo : hi));
+        }
+        out = _mm_or_ps(out, _mm_cmplt_ps(far, zero));
+        cross = _mm_or_ps(cross, _mm_cmplt_ps(near, zero));
+    }
+    outside = _mm_movemask_ps(out);
+    crossing = _mm_movemask_ps(cross);
+#else
+    outside = 0;
+    crossing = 0;
+    for (int i = 0; i < 4; i++) {
+        for (const auto& plane : view.planes) {
+            float far = plane[3];
+            float near = plane[3];
+            for (int axis = 0; axis < 3; axis++) {
+                const float lo = node.min[axis][i];
+                const float hi = node.max[axis][i];
+                far += plane[axis] * (plane[axis] >= 0 ? hi : lo);
+                near += plane[axis] * (plane[axis] >= 0 ? lo : hi);
+            }
+            outside |= far < 0 ? 1 << i : 0;
+            crossing |= near < 0 ? 1 << i : 0;
+        }
+    }
+#endif
+}
+} // namespace
+
+bool box_visible(const Bounds& box, const CullView& view) {
+    for (const auto& plane : view.planes) {
+        float far = plane[3];
+        for (int axis = 0; axis < 3; axis++) {
+            far += plane[axis] * (plane[axis] >= 0 ? box.max[axis] : box.min[axis]);
+        }
+        if (far < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Bvh::Bvh(const std::vector<Bounds>& boxes) : nodes(), order(boxes.size()) {
+    for (std::uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    if (boxes.empty() == false) {
+        build(boxes, 0, static_cast<std::uint32_t>(boxes.size()));
+    }
+}
+
+std::int32_t Bvh::build(const std::vector<Bounds>& boxes, std::uint32_t first,
+                        std::uint32_t count) {
+    const auto index = static_cast<std::int32_t>(nodes.size());
+    nodes.emplace_back();
+
+    // Ranges of order of the children, as boundaries
+    std::uint32_t bounds[NODE_WIDTH + 1];
+    std::uint32_t child_count;
+    if (count <= NODE_WIDTH) {
+        child_count = count;
+        for (std::uint32_t i = 0; i <= count; i++) {
+            bounds[i] = first + i;
+        }
+    } else {
+        // Split in halves, and the halves again, so that the children split along their own axes
+        std::uint32_t* begin = order.data() + first;
+        split_half(boxes, begin, begin + count);
+        split_half(boxes, begin, begin + count / 2);
+        split_half(boxes, begin + count / 2, begin + count);
+        child_count = NODE_WIDTH;
+        bounds[0] = first;
+        bounds[1] = first + count / 2 / 2;
+        bounds[2] = first + count / 2;
+        bounds[3] = first + count / 2 + (count - count / 2) / 2;
+        bounds[4] = first + count;
+    }
+
+    Node node{};
+    node.first = first;
+    node.count = count;
+    node.child_count = static_cast<int>(child_count);
+    for (std::uint32_t i = 0; i < child_count; i++) {
+        Bounds box = empty_bounds();
+        for (std::uint32_t j = bounds[i]; j < bounds[i + 1]; j++) {
+            merge(box, boxes[order[j]]);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            node.min[axis][i] = box.min[axis];
+            node.max[axis][i] = box.max[axis];
+        }
+        const std::uint32_t size = bounds[i + 1] - bounds[i];
+        node.child[i] = size == 1 ? ~static_cast<std::int32_t>(order[bounds[i]])
+                                  : build(boxes, bounds[i], size);
+    }
+    // Children were appended after this node, so it is only written back once they are built
+    nodes[index] = node;
+    return index;
+}
+
+void Bvh::cull(const CullView& view, std::vector<std::uint32_t>& visible) const {
+    visible.clear();
+    if (nodes.empty()) {
+        return;
+    }
+
+    std::vector<std::int32_t> stack{0};
+    while (stack.empty() == false) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        int outside = 0;
+        int crossing = 0;
+        test_children(node, view, outside, crossing);
+        for (int i = 0; i < node.child_count; i++) {
+            const int bit = 1 << i;
+            const std::int32_t child = node.child[i];
+            if (outside & bit) {
+                continue;
+            }
+            if (child < 0) {
+                visible.push_back(static_cast<std::uint32_t>(~child));
+            } else if (crossing & bit) {
+                stack.push_back(child);
+            } else {
+                // Inside all planes, so is every box below
+                const Node& inside = nodes[child];
+                visible.insert(visible.end(), order.begin() + inside.first,
+                               order.begin() + inside.first + inside.count);
+            }
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+}
+
+size_t Bvh::size() const { return order.size(); }
@@ -0,0 +1,54 @@
+#ifndef BVH_HPP_
+#define BVH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bounds.hpp"
+#include "meshlet.hpp"
+
+using std::size_t;
+
+// Returns false if the box is certainly outside the view volume.
+bool box_visible(const Bounds& box, const CullView& view);
+
+// Bounding volume hierarchy over axis-aligned boxes, for culling them against view volumes.
+//
+// Every node holds the boxes of up to four children side by side, so that one SIMD test checks
+// all four against a frustum plane.  Subtrees entirely inside the view volume are accepted without
+// testing their boxes.
+class Bvh final {
+  public:
+    explicit Bvh(const std::vector<Bounds>& boxes);
+
+    // Replaces visible with the indices of the boxes that are not certainly outside the view
+    // volume, in ascending order.
+    void cull(const CullView& view, std::vector<std::uint32_t>& visible) const;
+
+    // Returns the number of boxes.
+    size_t size() const;
+
+  private:
+    struct Node {
+        // Boxes of the children, one lane per child
+        float min[3][4];
+        float max[3][4];
+
+        // Index of the child node, or the bitwise complement of the box index for single boxes
+        std::int32_t child[4];
+        int child_count;
+
+        // Boxes of the subtree, as a range of order
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    std::vector<Node> nodes;
+    // Box indices, so that every subtree covers a contiguous range
+    std::vector<std::uint32_t> order;
+
+    std::int32_t build(const std::vector<Bounds>& boxes, std::uint32_t first, std::uint32_t count);
+};
+
+#endif
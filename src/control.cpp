@@ -38,6 +38,10 @@ void MvpControl::Impl::update(Mvp& mvp) {
     if (pressed == false) {
         accumulated.x = accumulated.y = 0;
     }
+    // Leave mvp untouched, so that it is not marked dirty without a change
+    if (accumulated == Vector3{0, 0, 0}) {
+        return;
+    }
     accumulated *= DIRECTION_SCALES;
 
     switch (mode) {
@@ -21,6 +21,7 @@ class MvpControl {
 
     // Applies accumulated changes to mvp.
     // The accumulated changes are zeroed at the end.
+    // Nothing is applied if there is no change, so that mvp only turns dirty on actual changes.
     void update(Mvp& mvp);
 
     // Adds offset to the accumulated value.
@@ -0,0 +1,261 @@
+#include "dirwatcher.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <unordered_map>
+#else
+#include <chrono>
+#include <map>
+#include <utility>
+#endif
+
+#include "manifest.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Keeps the last change of each file, in the order of those last changes
+void coalesce(std::vector<FileChange>& changes) {
+    std::vector<FileChange> kept;
+    std::unordered_set<std::string> seen;
+    for (auto it = changes.rbegin(); it != changes.rend(); ++it) {
+        if (seen.insert(it->path).second) {
+            kept.push_back(std::move(*it));
+        }
+    }
+    changes.assign(kept.rbegin(), kept.rend());
+}
+} // namespace
+
+#ifdef __linux__
+namespace {
+// Directories are watched for themselves appearing and disappearing too, to follow the tree
+const std::uint32_t WATCH_MASK =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR;
+} // namespace
+
+struct DirWatcher::Impl {
+    fs::path dir;
+    std::vector<std::string> exclude;
+    int fd;
+    // Watched directories by watch descriptor
+    std::unordered_map<int, fs::path> watched;
+
+    Impl(const fs::path& dir, const std::vector<std::string>& exclude);
+    ~Impl();
+    std::vector<FileChange> poll();
+
+    // Watches root and the directories below it.  Adds the files found to changes if not null.
+    // Returns false if root cannot be watched.
+    bool watch_tree(const fs::path& root, std::vector<FileChange>* changes);
+
+    // Stops watching root and the directories below it
+    void unwatch_tree(const fs::path& root);
+};
+
+DirWatcher::Impl::Impl(const fs::path& dir, const std::vector<std::string>& exclude)
+    : dir(dir), exclude(exclude), fd(-1), watched() {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to initialize inotify");
+    }
+    if (watch_tree(dir, nullptr) == false) {
+        close(fd);
+        throw std::runtime_error("Failed to watch " + dir.string());
+    }
+}
+
+DirWatcher::Impl::~Impl() { close(fd); }
+
+bool DirWatcher::Impl::watch_tree(const fs::path& root, std::vector<FileChange>* changes) {
+    // The watch is added before listing, so that files created meanwhile are not missed
+    const int wd = inotify_add_watch(fd, root.c_str(), WATCH_MASK);
+    if (wd == -1) {
+        return false;
+    }
+    watched[wd] = root;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+         ec == std::error_code() && it != end; it.increment(ec)) {
+        if (is_excluded(it->path(), exclude)) {
+            continue;
+        }
+        std::error_code entry_ec;
+        if (it->is_symlink(entry_ec) == false && it->is_directory(entry_ec)) {
+            if (watch_tree(it->path(), changes) == false) {
+                std::cerr << "Failed to watch " << it->path().string() << "\n";
+            }
+        } else if (changes != nullptr && it->is_regular_file(entry_ec)) {
+            changes->push_back(FileChange{FileChange::Kind::Written, it->path().string()});
+        }
+    }
+    return true;
+}
+
+void DirWatcher::Impl::unwatch_tree(const fs::path& root) {
+    for (auto it = watched.begin(); it != watched.end();) {
+        if (it->second == root || is_within(it->second, root)) {
+            // Fails harmlessly if the directory is already gone, which removed the watch
+            inotify_rm_watch(fd, it->first);
+            it = watched.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<FileChange> DirWatcher::Impl::poll() {
+    std::vector<FileChange> changes;
+    bool overflowed = false;
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        // Fails with EAGAIN once the queue is drained
+        const ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (const char* p = buffer; p < buffer + length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                overflowed = true;
+                continue;
+            }
+            // The watch of a deleted or unmounted directory is gone
+            if ((event->mask & IN_IGNORED) != 0) {
+                watched.erase(event->wd);
+                continue;
+            }
+            // Events of the directory itself have no name
+            const auto parent = watched.find(event->wd);
+            if (event->len == 0 || parent == watched.end()) {
+                continue;
+            }
+            const fs::path path = parent->second / event->name;
+            if (is_excluded(path, exclude)) {
+                continue;
+            }
+
+            const bool removed = (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0;
+            if ((event->mask & IN_ISDIR) != 0) {
+                if (removed) {
+                    unwatch_tree(path);
+                    changes.push_back(FileChange{FileChange::Kind::Removed, path.string()});
+                } else if (watch_tree(path, &changes) == false) {
+                    std::cerr << "Failed to watch " << path.string() << "\n";
+                }
+                continue;
+            }
+            // New files are reported once written and closed
+            if ((event->mask & IN_CREATE) != 0) {
+                continue;
+            }
+            changes.push_back(FileChange{removed ? FileChange::Kind::Removed
+                                                 : FileChange::Kind::Written,
+                                         path.string()});
+        }
+    }
+    if (overflowed) {
+        // Any change may have been lost, so report every file.  Watching the directories again
+        // keeps the existing watches and adds those of directories created meanwhile.
+        std::cerr << "Lost file changes under " << dir.string() << ", checking all files\n";
+        watch_tree(dir, &changes);
+    }
+    coalesce(changes);
+    return changes;
+}
+#else
+namespace {
+// Minimum time between two scans of the directory
+const std::chrono::seconds SCAN_INTERVAL{1};
+
+// Size and modification time of a file
+using FileState = std::pair<std::uintmax_t, fs::file_time_type>;
+} // namespace
+
+struct DirWatcher::Impl {
+    fs::path dir;
+    std::vector<std::string> exclude;
+    std::map<std::string, FileState> files;
+    std::chrono::steady_clock::time_point last_scan;
+
+    Impl(const fs::path& dir, const std::vector<std::string>& exclude);
+    std::vector<FileChange> poll();
+
+    // Returns the regular files under the directory that are not excluded
+    std::map<std::string, FileState> scan() const;
+};
+
+DirWatcher::Impl::Impl(const fs::path& dir, const std::vector<std::string>& exclude)
+    : dir(dir), exclude(exclude), files(), last_scan(std::chrono::steady_clock::now()) {
+    if (fs::is_directory(dir) == false) {
+        throw std::runtime_error("Failed to watch " + dir.string());
+    }
+    files = scan();
+}
+
+std::map<std::string, FileState> DirWatcher::Impl::scan() const {
+    std::map<std::string, FileState> found;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied,
+                                             ec),
+         end;
+         ec == std::error_code() && it != end; it.increment(ec)) {
+        std::error_code entry_ec;
+        if (is_excluded(it->path(), exclude)) {
+            if (it->is_directory(entry_ec)) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (it->is_regular_file(entry_ec)) {
+            const auto size = it->file_size(entry_ec);
+            const auto time = it->last_write_time(entry_ec);
+            if (!entry_ec) {
+                found.emplace(it->path().string(), FileState{size, time});
+            }
+        }
+    }
+    return found;
+}
+
+std::vector<FileChange> DirWatcher::Impl::poll() {
+    std::vector<FileChange> changes;
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_scan < SCAN_INTERVAL) {
+        return changes;
+    }
+    last_scan = now;
+
+    auto found = scan();
+    for (const auto& [path, state] : found) {
+        const auto it = files.find(path);
+        if (it == files.end() || it->second != state) {
+            changes.push_back(FileChange{FileChange::Kind::Written, path});
+        }
+    }
+    for (const auto& [path, state] : files) {
+        if (found.count(path) == 0) {
+            changes.push_back(FileChange{FileChange::Kind::Removed, path});
+        }
+    }
+    files = std::move(found);
+    return changes;
+}
+#endif
+
+DirWatcher::DirWatcher(const fs::path& dir, const std::vector<std::string>& exclude)
+    : impl(std::make_unique<Impl>(dir, exclude)) {}
+DirWatcher::~DirWatcher() = default;
+
+std::vector<FileChange> DirWatcher::poll() { return impl->poll(); }
@@ -0,0 +1,51 @@
+#ifndef DIRWATCHER_HPP_
+#define DIRWATCHER_HPP_
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Change of a file under a watched directory.
+struct FileChange {
+    enum class Kind {
+        // Created, moved in, or written and closed
+        Written,
+        // Deleted or moved out.  A removed directory is reported instead of the files in it.
+        Removed,
+    };
+    Kind kind;
+    std::string path;
+};
+
+// Watches the files under a directory recursively, skipping the entries that match exclusion
+// patterns as the scan for models does.  Symbolic links to directories are not followed.
+//
+// Uses inotify on Linux, with a watch per directory that is added as soon as the directory
+// appears.  Files found in a directory that is created or moved in are reported as written, and so
+// are all files if the event queue overflows.
+// Elsewhere the tree is rescanned for changed sizes and modification times, at most once per
+// second.
+class DirWatcher final {
+  public:
+    // Starts watching the directory, skipping the names that match the glob patterns of exclude.
+    // Throws if it cannot be watched.
+    DirWatcher(const std::filesystem::path& dir, const std::vector<std::string>& exclude);
+    ~DirWatcher();
+
+    // Prevent copy and move
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator=(const DirWatcher&) = delete;
+    DirWatcher(DirWatcher&&) = delete;
+    DirWatcher& operator=(DirWatcher&&) = delete;
+
+    // Returns the changes since the last call without blocking, at most one per file.
+    // Paths are the watched directory joined with the relative path of the file.
+    std::vector<FileChange> poll();
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
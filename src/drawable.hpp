@@ -1,11 +1,37 @@
 #ifndef DRAWABLE_HPP_
 #define DRAWABLE_HPP_
 
+#include <limits>
 #include <memory>
+#include <optional>
+
+#include "bounds.hpp"
+#include "matrix.hpp"
+
+// Per-frame state passed down to drawables.
+struct DrawContext {
+    // Matrix the drawable is rendered with
+    Matrix4 mvp;
+
+    // Diameter of the drawable's bounding sphere on screen, in pixels
+    float screen_size = std::numeric_limits<float>::infinity();
+
+    // Whether back faces are culled, so that parts facing away from the camera may be skipped
+    bool cull_backfaces = false;
+};
 
 class Drawable {
   public:
-    virtual void draw() const = 0;
+    virtual void draw(const DrawContext& context) const = 0;
+
+    // Returns the vertex array object the drawable is mostly drawn with, or 0 if unknown.
+    // Only used to group draws sharing it.
+    virtual unsigned int vertex_array() const { return 0; }
+
+    // Returns the box bounding everything the drawable draws, in the space its matrix maps from,
+    // or nothing if unknown.  Drawables outside the view are skipped.
+    virtual std::optional<Bounds> bounds() const { return std::nullopt; }
+
     virtual ~Drawable() = default;
 };
 
@@ -0,0 +1,13 @@
+#ifndef GLCONTEXT_HPP_
+#define GLCONTEXT_HPP_
+
+// Owner of an OpenGL context, either of a window on screen or of an offscreen framebuffer.
+class GlContext {
+  public:
+    virtual ~GlContext() = default;
+
+    // Makes the context current on the calling thread
+    virtual void make_current() const = 0;
+};
+
+#endif
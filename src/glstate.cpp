@@ -0,0 +1,148 @@
+#include "glstate.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace {
+// Value of state that was never set, or changed behind the shadow copy
+const GLuint UNKNOWN = ~GLuint{0};
+
+struct Binding {
+    GLenum target;
+    GLuint buffer;
+};
+
+struct Capability {
+    GLenum capability;
+    bool enabled;
+};
+
+struct State {
+    GLuint program = UNKNOWN;
+    GLuint vao = UNKNOWN;
+    std::vector<Binding> buffers;
+    GLenum polygon_mode = UNKNOWN;
+    std::vector<Capability> capabilities;
+    bool clear_color_known = false;
+    std::array<GLfloat, 4> clear_color{};
+
+    GlStateStats stats;
+};
+
+State& state() {
+    static State state;
+    return state;
+}
+
+// Returns true if the call changes the state, counting it either way
+bool changes(bool redundant) {
+    GlStateStats& stats = state().stats;
+    (redundant ? stats.skipped : stats.issued)++;
+    return redundant == false;
+}
+
+GLuint& buffer_binding(GLenum target) {
+    std::vector<Binding>& buffers = state().buffers;
+    const auto it = std::find_if(buffers.begin(), buffers.end(),
+                                 [&](const Binding& binding) { return binding.target == target; });
+    if (it != buffers.end()) {
+        return it->buffer;
+    }
+    buffers.push_back(Binding{target, UNKNOWN});
+    return buffers.back().buffer;
+}
+} // namespace
+
+void use_program(unsigned int program) {
+    if (changes(state().program == program)) {
+        glUseProgram(program);
+        state().program = program;
+    }
+}
+
+void bind_vertex_array(unsigned int vao) {
+    if (changes(state().vao == vao)) {
+        glBindVertexArray(vao);
+        state().vao = vao;
+        buffer_binding(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+    }
+}
+
+void bind_buffer(unsigned int target, unsigned int buffer) {
+    GLuint& bound = buffer_binding(target);
+    if (changes(bound == buffer)) {
+        glBindBuffer(target, buffer);
+        bound = buffer;
+    }
+}
+
+void bind_buffer_range(unsigned int target, unsigned int index, unsigned int buffer, size_t offset,
+                       size_t size) {
+    changes(false);
+    glBindBufferRange(target, index, buffer, static_cast<GLintptr>(offset),
+                      static_cast<GLsizeiptr>(size));
+    buffer_binding(target) = buffer;
+}
+
+void set_polygon_mode(unsigned int mode) {
+    if (changes(state().polygon_mode == mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+        state().polygon_mode = mode;
+    }
+}
+
+void set_enabled(unsigned int capability, bool enabled) {
+    std::vector<Capability>& capabilities = state().capabilities;
+    auto it = std::find_if(capabilities.begin(), capabilities.end(),
+                           [&](const Capability& c) { return c.capability == capability; });
+    if (it == capabilities.end()) {
+        // Unknown, so taken to differ
+        capabilities.push_back(Capability{capability, !enabled});
+        it = capabilities.end() - 1;
+    }
+    if (changes(it->enabled == enabled)) {
+        if (enabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+        it->enabled = enabled;
+    }
+}
+
+void set_clear_color(float red, float green, float blue, float alpha) {
+    const std::array<GLfloat, 4> color{red, green, blue, alpha};
+    if (changes(state().clear_color_known && state().clear_color == color)) {
+        glClearColor(red, green, blue, alpha);
+        state().clear_color = color;
+        state().clear_color_known = true;
+    }
+}
+
+void delete_buffer(unsigned int buffer) {
+    glDeleteBuffers(1, &buffer);
+    for (Binding& binding : state().buffers) {
+        if (binding.buffer == buffer) {
+            binding.buffer = 0;
+        }
+    }
+}
+
+void delete_vertex_array(unsigned int vao) {
+    glDeleteVertexArrays(1, &vao);
+    if (state().vao == vao) {
+        state().vao = 0;
+        buffer_binding(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+    }
+}
+
+void delete_program(unsigned int program) {
+    glDeleteProgram(program);
+    // A deleted program stays in use until another one is made current, so the binding holds
+}
+
+GlStateStats gl_state_stats() { return state().stats; }
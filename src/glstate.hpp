@@ -0,0 +1,53 @@
+#ifndef GLSTATE_HPP_
+#define GLSTATE_HPP_
+
+#include <cstddef>
+
+using std::size_t;
+
+// Shadow copy of the GL state set through the functions below, which skip calls that would set
+// what is already set.
+//
+// The tracked state must only be changed through these functions, or the shadow copy goes stale.
+// All of them must be called on the thread owning the context of the window.
+
+// Makes the program current.
+void use_program(unsigned int program);
+
+// Binds the vertex array object.
+void bind_vertex_array(unsigned int vao);
+
+// Binds the buffer to the target.
+// The element array binding belongs to the bound vertex array, so it is only known to be unchanged
+// while the same vertex array stays bound.
+void bind_buffer(unsigned int target, unsigned int buffer);
+
+// Binds a range of the buffer to the indexed binding point of the target, which binds it to the
+// target as well.  Ranges usually change with every draw, so the call is never skipped.
+void bind_buffer_range(unsigned int target, unsigned int index, unsigned int buffer, size_t offset,
+                       size_t size);
+
+// Sets the polygon mode of both faces.
+void set_polygon_mode(unsigned int mode);
+
+// Enables or disables the capability.
+void set_enabled(unsigned int capability, bool enabled);
+
+void set_clear_color(float red, float green, float blue, float alpha);
+
+// Deletes the object, and forgets it wherever it is bound, since GL unbinds deleted objects and
+// may hand their names out again.
+void delete_buffer(unsigned int buffer);
+void delete_vertex_array(unsigned int vao);
+void delete_program(unsigned int program);
+
+// Numbers of state changing calls passed on to GL and skipped as redundant.
+struct GlStateStats {
+    size_t issued = 0;
+    size_t skipped = 0;
+};
+
+// Returns the numbers of calls since the program started.
+GlStateStats gl_state_stats();
+
+#endif
@@ -0,0 +1,113 @@
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace {
+const std::uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const std::uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const std::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const std::uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+// Size of blocks hashed independently by hash_bytes_parallel
+const size_t BLOCK_SIZE = 1 << 22;
+
+std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+std::uint64_t read64(const unsigned char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+std::uint64_t xxh_round(std::uint64_t acc, std::uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+std::uint64_t merge_round(std::uint64_t acc, std::uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+} // namespace
+
+std::uint64_t hash_bytes(const void* data, size_t size, std::uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    std::uint64_t h;
+
+    if (size >= 32) {
+        std::uint64_t v1 = seed + PRIME1 + PRIME2;
+        std::uint64_t v2 = seed + PRIME2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - PRIME1;
+        for (; end - p >= 32; p += 32) {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += static_cast<std::uint64_t>(size);
+    for (; end - p >= 8; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4) {
+        h ^= static_cast<std::uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::uint64_t hash_bytes_parallel(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const size_t block_count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (block_count <= 1) {
+        return hash_bytes(data, size);
+    }
+
+    // Hash fixed-size blocks, then hash the list of block hashes
+    std::vector<std::uint64_t> hashes(block_count);
+    const size_t thread_count =
+        std::clamp<size_t>(std::thread::hardware_concurrency(), 1, block_count);
+    parallel_for(thread_count, [&](size_t t) {
+        for (size_t i = block_count * t / thread_count; i < block_count * (t + 1) / thread_count;
+             i++) {
+            const size_t offset = i * BLOCK_SIZE;
+            hashes[i] = hash_bytes(bytes + offset, std::min(BLOCK_SIZE, size - offset), i);
+        }
+    });
+    return hash_bytes(hashes.data(), hashes.size() * sizeof(std::uint64_t), size);
+}
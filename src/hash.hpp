@@ -0,0 +1,16 @@
+#ifndef HASH_HPP_
+#define HASH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+using std::size_t;
+
+// Non-cryptographic 64-bit hash of a byte range (XXH64).
+std::uint64_t hash_bytes(const void* data, size_t size, std::uint64_t seed = 0);
+
+// Hashes a large byte range with multiple threads.
+// The result depends only on the contents, not on the number of threads.
+std::uint64_t hash_bytes_parallel(const void* data, size_t size);
+
+#endif
@@ -0,0 +1,225 @@
+#include "headless.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_EGL
+
+#include <glad/glad.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string_view>
+
+namespace {
+const EGLint CONFIG_ATTRIBS[] = {
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    // Nothing is drawn to EGL surfaces, so configs without any are fine
+    EGL_SURFACE_TYPE, EGL_DONT_CARE,
+    EGL_NONE,
+};
+
+const EGLint CONTEXT_ATTRIBS[] = {
+    EGL_CONTEXT_MAJOR_VERSION_KHR,
+    3,
+    EGL_CONTEXT_MINOR_VERSION_KHR,
+    3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+    EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+    EGL_NONE,
+};
+
+// Returns true if the space separated list of extensions contains the name
+bool has_extension(const char* extensions, std::string_view name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+    std::istringstream in{extensions};
+    std::string extension;
+    while (in >> extension) {
+        if (extension == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Opens the display of the surfaceless platform of Mesa, which needs neither a display server nor
+// a GPU, or the default display if the platform is not supported
+EGLDisplay open_display() {
+    if (has_extension(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS),
+                      "EGL_MESA_platform_surfaceless")) {
+        const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display != nullptr) {
+            const EGLDisplay display =
+                get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+std::runtime_error egl_error(const std::string& what) {
+    std::ostringstream message;
+    message << what << " (EGL error 0x" << std::hex << eglGetError() << ")";
+    return std::runtime_error(message.str());
+}
+} // namespace
+
+struct HeadlessContext::Impl {
+    Impl(int width, int height);
+
+    // Delete the framebuffer and terminate EGL
+    ~Impl();
+
+    // Prevent copy and move
+    Impl(const Impl&) = delete;
+    Impl& operator=(const Impl&) = delete;
+    Impl(Impl&&) = delete;
+    Impl& operator=(Impl&&) = delete;
+
+    void make_current() const;
+
+    EGLDisplay display;
+    EGLContext context;
+
+    int width;
+    int height;
+
+    GLuint framebuffer;
+    GLuint color;
+    GLuint depth;
+};
+
+HeadlessContext::HeadlessContext(int width, int height)
+    : impl(std::make_unique<Impl>(width, height)) {}
+HeadlessContext::Impl::Impl(int width, int height)
+    : display(open_display()), context(EGL_NO_CONTEXT), width(width), height(height),
+      framebuffer(0), color(0), depth(0) {
+    if (width <= 0 || height <= 0) {
+        throw std::runtime_error("Invalid framebuffer size " + std::to_string(width) + "x" +
+                                 std::to_string(height));
+    }
+    if (display == EGL_NO_DISPLAY || eglInitialize(display, nullptr, nullptr) == EGL_FALSE) {
+        throw egl_error("Failed to initialize EGL");
+    }
+
+    // The context is made current without any surface
+    if (has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context") ==
+        false) {
+        eglTerminate(display);
+        throw std::runtime_error("EGL does not support surfaceless contexts");
+    }
+
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (eglBindAPI(EGL_OPENGL_API) == EGL_FALSE ||
+        eglChooseConfig(display, CONFIG_ATTRIBS, &config, 1, &config_count) == EGL_FALSE ||
+        config_count == 0) {
+        const auto error = egl_error("No EGL config supports OpenGL");
+        eglTerminate(display);
+        throw error;
+    }
+
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, CONTEXT_ATTRIBS);
+    if (context == EGL_NO_CONTEXT ||
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_FALSE) {
+        const auto error = egl_error("Failed to create OpenGL 3.3 context");
+        eglTerminate(display);
+        throw error;
+    }
+
+    // Load OpenGL function pointers
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        eglTerminate(display);
+        throw std::runtime_error("Failed to initialize GLAD");
+    }
+
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        eglTerminate(display);
+        throw std::runtime_error("Offscreen framebuffer is incomplete");
+    }
+    glViewport(0, 0, width, height);
+}
+
+HeadlessContext::~HeadlessContext() = default;
+HeadlessContext::Impl::~Impl() {
+    make_current();
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+void HeadlessContext::make_current() const { impl->make_current(); }
+void HeadlessContext::Impl::make_current() const {
+    if (eglGetCurrentContext() != context) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+}
+
+int HeadlessContext::width() const { return impl->width; }
+int HeadlessContext::height() const { return impl->height; }
+
+std::string HeadlessContext::renderer() const {
+    make_current();
+    const auto name = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    return name != nullptr ? name : "unknown";
+}
+
+std::vector<unsigned char> HeadlessContext::read_pixels() const {
+    make_current();
+    const auto width = static_cast<size_t>(impl->width);
+    const auto height = static_cast<size_t>(impl->height);
+    const size_t row_bytes = width * 3;
+
+    std::vector<unsigned char> rows(row_bytes * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, impl->width, impl->height, GL_RGB, GL_UNSIGNED_BYTE, rows.data());
+
+    // OpenGL reads the bottom row first
+    for (size_t y = 0; y < height / 2; y++) {
+        std::swap_ranges(rows.begin() + y * row_bytes, rows.begin() + (y + 1) * row_bytes,
+                         rows.begin() + (height - 1 - y) * row_bytes);
+    }
+    return rows;
+}
+
+#else
+
+struct HeadlessContext::Impl {};
+
+HeadlessContext::HeadlessContext(int, int) {
+    throw std::runtime_error("Headless rendering is not available, since EGL was not found when "
+                             "building");
+}
+HeadlessContext::~HeadlessContext() = default;
+
+void HeadlessContext::make_current() const {}
+int HeadlessContext::width() const { return 0; }
+int HeadlessContext::height() const { return 0; }
+std::string HeadlessContext::renderer() const { return {}; }
+std::vector<unsigned char> HeadlessContext::read_pixels() const { return {}; }
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef HEADLESS_HPP_
+#define HEADLESS_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glcontext.hpp"
+
+// Offscreen OpenGL context without a window, rendering into a framebuffer object.
+//
+// The context is created through EGL on the surfaceless platform of Mesa, so that no display
+// server is needed.  On machines without a GPU, Mesa renders on the CPU with llvmpipe.
+// Only available if built with EGL.
+class HeadlessContext final : public GlContext {
+  public:
+    // Creates the context and a framebuffer of the size, and makes both current.
+    // Throws if the context cannot be created.
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+
+    // Prevent copy, allow move
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+    HeadlessContext(HeadlessContext&&) = default;
+    HeadlessContext& operator=(HeadlessContext&&) = default;
+
+    // Makes the context current, with its framebuffer bound
+    virtual void make_current() const override;
+
+    int width() const;
+    int height() const;
+
+    // Returns the name of the OpenGL renderer, such as llvmpipe.
+    std::string renderer() const;
+
+    // Reads back the framebuffer as rows of 8-bit RGB pixels, top row first.
+    // Waits for the rendering to finish.
+    std::vector<unsigned char> read_pixels() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
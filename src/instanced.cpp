@@ -0,0 +1,160 @@
+#include "instanced.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "glstate.hpp"
+
+namespace {
+// Instances drawn into the occlusion buffer, nearest first.  Far ones rarely hide anything the near
+// ones do not.
+const size_t MAX_OCCLUDING_INSTANCES = 32;
+
+// Writes the selected matrices column-major, as read by the mat4 attribute
+std::vector<GLfloat> column_major(const std::vector<Matrix4>& matrices,
+                                  const std::vector<std::uint32_t>& selected) {
+    std::vector<GLfloat> data(16 * selected.size());
+    for (size_t i = 0; i < selected.size(); i++) {
+        const Matrix4& m = matrices[selected[i]];
+        for (size_t row = 0; row < 4; row++) {
+            for (size_t column = 0; column < 4; column++) {
+                data[16 * i + 4 * column + row] = m[4 * row + column];
+            }
+        }
+    }
+    return data;
+}
+
+// Returns the boxes the matrices place models normalized into [-1, 1] in
+std::vector<Bounds> instance_bounds(const std::vector<Matrix4>& matrices) {
+    std::vector<Bounds> boxes(matrices.size());
+    for (size_t i = 0; i < matrices.size(); i++) {
+        const Matrix4& m = matrices[i];
+        for (size_t row = 0; row < 3; row++) {
+            // The corners of the cube reach the sum of the absolute values of the row
+            const float extent = std::abs(m[4 * row]) + std::abs(m[4 * row + 1]) +
+                                 std::abs(m[4 * row + 2]);
+            boxes[i].min[row] = m[4 * row + 3] - extent;
+            boxes[i].max[row] = m[4 * row + 3] + extent;
+        }
+    }
+    return boxes;
+}
+
+// Returns the largest length of the axes of the matrices
+float max_axis_length(const std::vector<Matrix4>& matrices) {
+    float scale = 0;
+    for (const auto& m : matrices) {
+        for (size_t axis = 0; axis < 3; axis++) {
+            const float x = m[axis];
+            const float y = m[4 + axis];
+            const float z = m[8 + axis];
+            scale = std::max(scale, std::sqrt(x * x + y * y + z * z));
+        }
+    }
+    return scale;
+}
+} // namespace
+
+InstanceBuffer::InstanceBuffer(const std::vector<Matrix4>& matrices)
+    : name(0), capacity(0), scale(0), matrices(), boxes(), tree(), visible(), occluded(0) {
+    glGenBuffers(1, &name);
+    update(matrices);
+}
+
+InstanceBuffer::~InstanceBuffer() { delete_buffer(name); }
+
+void InstanceBuffer::update(const std::vector<Matrix4>& matrices) {
+    this->matrices = matrices;
+    boxes = instance_bounds(matrices);
+    tree = std::make_unique<Bvh>(boxes);
+    occluded = 0;
+    scale = max_axis_length(matrices);
+
+    visible.resize(matrices.size());
+    for (std::uint32_t i = 0; i < visible.size(); i++) {
+        visible[i] = i;
+    }
+    upload();
+}
+
+void InstanceBuffer::cull(const Matrix4& mvp, const Occluder* occluder, OcclusionBuffer* depth) {
+    std::vector<std::uint32_t> next;
+    tree->cull(cull_view(mvp), next);
+    occluded = 0;
+    if (occluder != nullptr && depth != nullptr) {
+        cull_occluded(mvp, *occluder, *depth, next);
+    }
+    // The camera is mostly still, so the buffer is only written when the set changes
+    if (next != visible) {
+        visible = std::move(next);
+        upload();
+    }
+}
+
+void InstanceBuffer::cull_occluded(const Matrix4& mvp, const Occluder& occluder,
+                                   OcclusionBuffer& depth, std::vector<std::uint32_t>& candidates) {
+    // Clip space w of the origin of each instance grows with its distance from the camera
+    std::vector<std::pair<float, std::uint32_t>> nearest;
+    nearest.reserve(candidates.size());
+    for (const std::uint32_t i : candidates) {
+        const Matrix4& m = matrices[i];
+        const float w = mvp[12] * m[3] + mvp[13] * m[7] + mvp[14] * m[11] + mvp[15];
+        nearest.emplace_back(w, i);
+    }
+    const size_t occluder_count = std::min(MAX_OCCLUDING_INSTANCES, nearest.size());
+    std::partial_sort(nearest.begin(), nearest.begin() + occluder_count, nearest.end());
+
+    std::vector<Matrix4> mvps;
+    for (size_t i = 0; i < occluder_count; i++) {
+        mvps.push_back(mvp * matrices[nearest[i].second]);
+    }
+    depth.clear();
+    depth.rasterize(occluder, mvps);
+    depth.build_pyramid();
+
+    // The occluders lie within their own boxes, so they never hide themselves
+    const auto hidden = [&](std::uint32_t i) { return depth.box_visible(boxes[i], mvp) == false; };
+    const auto end = std::remove_if(candidates.begin(), candidates.end(), hidden);
+    occluded = static_cast<size_t>(candidates.end() - end);
+    candidates.erase(end, candidates.end());
+}
+
+void InstanceBuffer::upload() {
+    const std::vector<GLfloat> data = column_major(matrices, visible);
+    const auto bytes = static_cast<GLsizeiptr>(data.size() * sizeof(GLfloat));
+    bind_buffer(GL_ARRAY_BUFFER, name);
+    if (visible.size() <= capacity && capacity > 0) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.data());
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, bytes, data.data(), GL_DYNAMIC_DRAW);
+        capacity = visible.size();
+    }
+}
+
+unsigned int InstanceBuffer::buffer() const { return name; }
+size_t InstanceBuffer::count() const { return visible.size(); }
+size_t InstanceBuffer::total_count() const { return matrices.size(); }
+size_t InstanceBuffer::occluded_count() const { return occluded; }
+float InstanceBuffer::max_scale() const { return scale; }
+
+std::vector<Matrix4> grid_instances(size_t count) {
+    const auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const float scale = side > 0 ? 1.0f / static_cast<float>(side) : 1.0f;
+
+    std::vector<Matrix4> matrices;
+    matrices.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        // Cells are 2 * scale wide, centered around the origin
+        const float x = (2 * static_cast<float>(i % side) + 1) * scale - 1;
+        const float z = (2 * static_cast<float>(i / side) + 1) * scale - 1;
+        matrices.emplace_back(scale, 0, 0, x, //
+                              0, scale, 0, 0, //
+                              0, 0, scale, z, //
+                              0, 0, 0, 1);
+    }
+    return matrices;
+}
@@ -0,0 +1,80 @@
+#ifndef INSTANCED_HPP_
+#define INSTANCED_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bvh.hpp"
+#include "matrix.hpp"
+#include "occlusion.hpp"
+
+using std::size_t;
+
+// Per-instance model matrices in a vertex buffer, read by the shader as attributes with divisor 1.
+//
+// The bounding boxes of the instances are kept in a hierarchy, so that only the matrices of the
+// instances in view are uploaded and drawn.  Instances hidden behind the nearest ones may be culled
+// as well, by drawing those into a software depth buffer.
+class InstanceBuffer final {
+  public:
+    explicit InstanceBuffer(const std::vector<Matrix4>& matrices);
+    ~InstanceBuffer();
+
+    // Prevent copy and move
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+    InstanceBuffer(InstanceBuffer&&) = delete;
+    InstanceBuffer& operator=(InstanceBuffer&&) = delete;
+
+    // Replaces the matrices, reusing the buffer storage if they fit.  All instances are drawn until
+    // the next cull.
+    void update(const std::vector<Matrix4>& matrices);
+
+    // Leaves only the instances that are not certainly outside the view volume of the matrix in
+    // the buffer.  The matrix maps from the space the matrices place the instances in.
+    //
+    // If an occluder and a depth buffer are given, the nearest visible instances are drawn as the
+    // occluder into the depth buffer, and instances whose boxes are hidden behind them are left out
+    // as well.
+    void cull(const Matrix4& mvp, const Occluder* occluder = nullptr,
+              OcclusionBuffer* depth = nullptr);
+
+    // Returns the name of the GL buffer.
+    unsigned int buffer() const;
+
+    // Returns the number of instances in the buffer, which are drawn.
+    size_t count() const;
+
+    // Returns the number of instances, visible or not.
+    size_t total_count() const;
+
+    // Returns the number of instances in view that the last cull found hidden behind others.
+    size_t occluded_count() const;
+
+    // Returns the largest factor by which any of the matrices scales a model.
+    float max_scale() const;
+
+  private:
+    unsigned int name;
+    // Instances the storage of the buffer can hold
+    size_t capacity;
+    float scale;
+
+    std::vector<Matrix4> matrices;
+    std::vector<Bounds> boxes;
+    std::unique_ptr<Bvh> tree;
+    std::vector<std::uint32_t> visible;
+    size_t occluded;
+
+    void upload();
+    void cull_occluded(const Matrix4& mvp, const Occluder& occluder, OcclusionBuffer& depth,
+                       std::vector<std::uint32_t>& candidates);
+};
+
+// Returns matrices placing count copies of a model normalized into [-1, 1] on a square grid in the
+// xz plane.  The copies are scaled down so that the whole grid fits into [-1, 1] as well.
+std::vector<Matrix4> grid_instances(size_t count);
+
+#endif
@@ -1,12 +1,21 @@
 #include <exception>
+#include <filesystem>
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <string>
+#include <vector>
 
+#include "batch.hpp"
 #include "control.hpp"
+#include "dirwatcher.hpp"
+#include "manifest.hpp"
 #include "matrix.hpp"
+#include "meshcache.hpp"
 #include "model.hpp"
+#include "options.hpp"
 #include "prompt.hpp"
+#include "quad.hpp"
 #include "resources.hpp"
 #include "scene.hpp"
 #include "shader.hpp"
@@ -15,11 +24,23 @@
 
 using std::size_t;
 
-void init();
+void init(const Options& options);
 
-int main() {
+int main(int argc, char* argv[]) {
+    Options options;
     try {
-        init();
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n" << options_usage();
+        return 1;
+    }
+    if (options.help) {
+        std::cout << options_usage();
+        return 0;
+    }
+
+    try {
+        init(options);
     } catch (const std::exception& e) {
         std::cerr << "Exception caught: " << e.what() << "\n";
         return 1;
@@ -27,9 +48,26 @@ int main() {
     return 0;
 }
 
-void init() {
+void init(const Options& options) {
     // Prompt for model path before GLFW window creation
-    const auto model_paths = prompt_model_paths();
+    const std::filesystem::path model_dir =
+        options.model_dir.empty() ? prompt_dir() : std::filesystem::path(options.model_dir);
+    // The manifest is kept next to the mesh cache, and shares its switch
+    std::filesystem::path manifest_dir;
+    if (options.model.cache) {
+        manifest_dir = options.model.cache_dir.empty()
+                           ? MeshCache::default_dir()
+                           : std::filesystem::path(options.model.cache_dir);
+    }
+    std::vector<std::string> model_paths;
+    for (const auto& entry : load_manifest(model_dir, options.scan, manifest_dir)) {
+        model_paths.push_back(entry.path);
+    }
+
+    if (options.batch.output_dir.empty() == false) {
+        render_batch(model_dir, model_paths, options.model, options.batch);
+        return;
+    }
 
     // Initialize glfw and window
     Glfw glfw{};
@@ -39,10 +77,25 @@ void init() {
     Shader shader{window, resources::SHADER_VS, resources::SHADER_FS};
 
     // Load models
-    ModelList models{model_paths};
+    ModelList models{model_paths, options.model};
+    if (manifest_dir.empty() == false) {
+        models.track_manifest({model_dir, options.scan.exclude, manifest_dir});
+    }
+
+    // Watch the model tree, so that re-exported models are reloaded while the viewer is open
+    std::optional<DirWatcher> watcher;
+    try {
+        watcher.emplace(model_dir, options.scan.exclude);
+    } catch (const std::exception& e) {
+        std::cerr << "Models will not be reloaded on change:\n" << e.what() << "\n";
+    }
 
     // Setup scene
-    Scene scene{std::move(shader), {0.2f, 0.2f, 0.2f}, std::make_unique<ModelList>(models)};
+    Scene scene{std::move(shader), {0.2f, 0.2f, 0.2f}};
+    scene.add_layer("models");
+    scene.add("models", std::make_unique<ModelList>(models));
+    scene.add_layer("floor", {false, false});
+    scene.add("floor", std::make_unique<Quad>());
 
     // Setup transformation and control objects
     Mvp mvp{Window::DEFAULT_WIDTH, Window::DEFAULT_HEIGHT};
@@ -52,7 +105,12 @@ void init() {
     window.on_keydown(Key::Z, [&]() { models.prev_model(); });
     window.on_keydown(Key::X, [&]() { models.next_model(); });
     window.on_keydown(Key::W, [&]() { scene.switch_render_mode(); });
-    window.on_keydown(Key::I, [&]() { mvp.debug_print(); });
+    window.on_keydown(Key::I, [&]() {
+        mvp.debug_print();
+        models.debug_print();
+        scene.debug_print();
+    });
+    window.on_keydown(Key::J, [&]() { models.print_stats_json(std::cout); });
     window.on_keydown(Key::O, [&]() { mvp.set_project_mode(Mvp::ProjectMode::Orthogonal); });
     window.on_keydown(Key::P, [&]() { mvp.set_project_mode(Mvp::ProjectMode::Perspective); });
 
@@ -63,6 +121,11 @@ void init() {
     window.on_keydown(Key::C, [&]() { control.set_mode(MvpControl::Mode::TranslateViewCenter); });
     window.on_keydown(Key::U, [&]() { control.set_mode(MvpControl::Mode::TranslateViewUp); });
 
+    window.on_keydown(Key::B, [&]() {
+        const bool on = scene.toggle_backface_culling();
+        std::cerr << "Backface culling: " << std::boolalpha << on << "\n";
+    });
+
     window.on_keydown(Key::V, [&]() {
         const bool on = window.toggle_vsync();
         std::cerr << "Vsync: " << std::boolalpha << on << "\n";
@@ -85,9 +148,42 @@ void init() {
 
     window.on_size_change([&](int width, int height) { mvp.set_viewport_size(width, height); });
 
-    // Run the main loop
-    window.loop([&]() {
+    // Applies file changes and accumulated input before each frame
+    const auto update = [&]() {
+        if (watcher.has_value()) {
+            for (const auto& change : watcher->poll()) {
+                // Removed paths may be directories holding models
+                if (change.kind == FileChange::Kind::Removed) {
+                    models.remove(change.path);
+                } else if (is_model_file(change.path)) {
+                    models.reload(change.path);
+                }
+            }
+            models.flush_manifest();
+        }
         control.update(mvp);
+    };
+
+    // Run the main loop
+    if (options.on_demand == false) {
+        window.loop([&]() {
+            update();
+            scene.render(window, mvp);
+        });
+        return;
+    }
+    window.loop_on_demand([&]() {
+        update();
+        // Every flag is taken, so that none stays raised for a frame that is not needed
+        bool dirty = window.take_dirty();
+        dirty |= mvp.take_dirty();
+        dirty |= models.take_dirty();
+        dirty |= scene.take_dirty();
+        const bool pending = models.busy();
+        if (dirty == false && pending == false) {
+            return FrameStatus::Idle;
+        }
         scene.render(window, mvp);
+        return pending ? FrameStatus::Pending : FrameStatus::Drawn;
     });
 }
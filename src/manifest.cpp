@@ -0,0 +1,316 @@
+#include "manifest.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include "hash.hpp"
+#include "objreader.hpp"
+#include "prompt.hpp"
+#include "threadpool.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+const char* MANIFEST_MAGIC = "cg1-manifest";
+// Bump whenever the layout of the file changes
+const int MANIFEST_VERSION = 1;
+
+// Returns true if the whole name matches the glob pattern
+bool glob_match(const char* pattern, const char* name) {
+    // Backtrack to the last star on a mismatch, letting it match one more character
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name != '\0') {
+        if (*pattern == '?' || (*pattern != '*' && *pattern == *name)) {
+            pattern++;
+            name++;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (star != nullptr) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+size_t thread_count() { return std::max<size_t>(std::thread::hardware_concurrency(), 1); }
+
+// Lists the model files under dir, with the threads sharing a queue of directories to list
+std::vector<fs::path> find_model_files(const fs::path& dir,
+                                       const std::vector<std::string>& exclude) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<fs::path> pending{dir};
+    // Directories being listed, which may add more to pending
+    size_t listing = 0;
+    std::vector<fs::path> files;
+
+    parallel_for(thread_count(), [&](size_t) {
+        std::unique_lock lock(mutex);
+        for (;;) {
+            changed.wait(lock, [&]() { return pending.empty() == false || listing == 0; });
+            if (pending.empty()) {
+                return;
+            }
+            const fs::path current = std::move(pending.front());
+            pending.pop_front();
+            listing++;
+            lock.unlock();
+
+            std::vector<fs::path> subdirs;
+            std::vector<fs::path> found;
+            std::error_code ec;
+            for (fs::directory_iterator it(current, fs::directory_options::skip_permission_denied,
+                                           ec),
+                 end;
+                 ec == std::error_code() && it != end; it.increment(ec)) {
+                if (is_excluded(it->path(), exclude)) {
+                    continue;
+                }
+                std::error_code entry_ec;
+                if (it->is_symlink(entry_ec) == false && it->is_directory(entry_ec)) {
+                    subdirs.push_back(it->path());
+                } else if (it->is_regular_file(entry_ec) && is_model_file(it->path())) {
+                    found.push_back(it->path());
+                }
+            }
+
+            lock.lock();
+            listing--;
+            pending.insert(pending.end(), subdirs.begin(), subdirs.end());
+            files.insert(files.end(), found.begin(), found.end());
+            changed.notify_all();
+        }
+    });
+    return files;
+}
+
+std::int64_t mtime_of(const fs::path& path, std::error_code& ec) {
+    return static_cast<std::int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+}
+
+fs::path manifest_path(const fs::path& manifest_dir, const std::string& dir) {
+    const std::uint64_t name = hash_bytes(dir.data(), dir.size());
+    std::ostringstream filename;
+    filename << std::hex << std::setw(16) << std::setfill('0') << name << ".manifest";
+    return manifest_dir / filename.str();
+}
+
+// Returns the entry of the model file, with zero counts if it cannot be sniffed
+ManifestEntry make_entry(const fs::path& path) {
+    ManifestEntry entry;
+    entry.path = path.string();
+    std::error_code ec;
+    entry.size = fs::file_size(path, ec);
+    entry.size = ec ? 0 : entry.size;
+    entry.mtime = mtime_of(path, ec);
+    try {
+        const ObjCounts counts = sniff_obj_counts(entry.path);
+        entry.vertex_count = counts.vertex_count;
+        entry.face_count = counts.face_count;
+    } catch (const std::exception&) {
+        entry.vertex_count = 0;
+        entry.face_count = 0;
+    }
+    return entry;
+}
+
+// The manifest is a text file holding a header line with the magic and version, the directory,
+// the number of exclusion patterns and the patterns, the number of entries, and one line per
+// entry with the size, modification time, counts and path.
+
+// Returns the entries of the manifest, or nothing if it is missing, corrupt, or of another tree
+std::optional<std::vector<ManifestEntry>> read_manifest(const fs::path& path,
+                                                        const std::string& dir,
+                                                        const std::vector<std::string>& exclude) {
+    std::ifstream in{path};
+    std::string magic;
+    int version = 0;
+    std::string line;
+    if (!(in >> magic >> version) || magic != MANIFEST_MAGIC || version != MANIFEST_VERSION ||
+        !std::getline(in, line) || !std::getline(in, line) || line != dir) {
+        return std::nullopt;
+    }
+
+    size_t exclude_count = 0;
+    if (!(in >> exclude_count) || !std::getline(in, line) || exclude_count != exclude.size()) {
+        return std::nullopt;
+    }
+    for (const auto& pattern : exclude) {
+        if (!std::getline(in, line) || line != pattern) {
+            return std::nullopt;
+        }
+    }
+
+    size_t count = 0;
+    if (!(in >> count)) {
+        return std::nullopt;
+    }
+    std::vector<ManifestEntry> entries;
+    for (size_t i = 0; i < count; i++) {
+        ManifestEntry entry;
+        if (!(in >> entry.size >> entry.mtime >> entry.vertex_count >> entry.face_count) ||
+            in.get() != ' ' || !std::getline(in, entry.path)) {
+            return std::nullopt;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+// Stores the manifest, replacing the existing one atomically.  Throws on I/O errors.
+void write_manifest(const fs::path& path, const std::string& dir,
+                    const std::vector<std::string>& exclude,
+                    const std::vector<ManifestEntry>& entries) {
+    std::vector<const ManifestEntry*> stored;
+    for (const auto& entry : entries) {
+        // One line per entry leaves no room for line breaks
+        if (entry.path.find('\n') == std::string::npos) {
+            stored.push_back(&entry);
+        }
+    }
+
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out{tmp, std::ios::trunc};
+        out << MANIFEST_MAGIC << " " << MANIFEST_VERSION << "\n" << dir << "\n";
+        out << exclude.size() << "\n";
+        for (const auto& pattern : exclude) {
+            out << pattern << "\n";
+        }
+        out << stored.size() << "\n";
+        for (const ManifestEntry* entry : stored) {
+            out << entry->size << " " << entry->mtime << " " << entry->vertex_count << " "
+                << entry->face_count << " " << entry->path << "\n";
+        }
+        if (out.good() == false) {
+            out.close();
+            fs::remove(tmp);
+            throw std::runtime_error("Failed to write manifest " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+}
+} // namespace
+
+bool is_excluded(const fs::path& path, const std::vector<std::string>& exclude) {
+    const std::string name = path.filename().string();
+    return std::any_of(exclude.begin(), exclude.end(), [&](const std::string& pattern) {
+        return glob_match(pattern.c_str(), name.c_str());
+    });
+}
+
+bool is_within(const fs::path& path, const fs::path& dir) {
+    auto it = path.begin();
+    for (const auto& part : dir) {
+        // A trailing separator leaves an empty last part
+        if (part.empty()) {
+            continue;
+        }
+        if (it == path.end() || *it != part) {
+            return false;
+        }
+        ++it;
+    }
+    return it != path.end();
+}
+
+std::vector<ManifestEntry> scan_models(const fs::path& dir,
+                                       const std::vector<std::string>& exclude) {
+    const std::vector<fs::path> files = find_model_files(dir, exclude);
+
+    // Sniffing touches a few pages of every file, so it is spread over the threads as well
+    std::vector<ManifestEntry> entries(files.size());
+    const size_t threads = std::min(thread_count(), std::max<size_t>(files.size(), 1));
+    parallel_for(threads, [&](size_t t) {
+        for (size_t i = files.size() * t / threads; i < files.size() * (t + 1) / threads; i++) {
+            entries[i] = make_entry(files[i]);
+        }
+    });
+
+    std::sort(entries.begin(), entries.end(),
+              [](const ManifestEntry& a, const ManifestEntry& b) { return a.path < b.path; });
+    return entries;
+}
+
+std::vector<ManifestEntry> load_manifest(const fs::path& dir, const ScanOptions& options,
+                                         const fs::path& manifest_dir) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::string key = dir.string();
+
+    std::optional<std::vector<ManifestEntry>> entries;
+    if (manifest_dir.empty() == false && options.rescan == false) {
+        entries = read_manifest(manifest_path(manifest_dir, key), key, options.exclude);
+    }
+    const bool scanned = entries.has_value() == false;
+    if (scanned) {
+        entries = scan_models(dir, options.exclude);
+        if (manifest_dir.empty() == false) {
+            try {
+                fs::create_directories(manifest_dir);
+                write_manifest(manifest_path(manifest_dir, key), key, options.exclude, *entries);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to store manifest:\n" << e.what() << "\n";
+            }
+        }
+    }
+
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << (scanned ? "Scanned " : "Read manifest of ") << entries->size()
+              << " models under " << key << " in " << elapsed.count() << " ms\n";
+
+    if (options.order == ScanOptions::Order::Size) {
+        std::stable_sort(entries->begin(), entries->end(),
+                         [](const ManifestEntry& a, const ManifestEntry& b) {
+                             return a.size < b.size;
+                         });
+    }
+    return std::move(*entries);
+}
+
+void update_manifest(const ManifestLocation& location, const std::vector<ManifestChange>& changes) {
+    const std::string key = location.dir.string();
+    const fs::path file = manifest_path(location.manifest_dir, key);
+    auto entries = read_manifest(file, key, location.exclude);
+    if (entries.has_value() == false) {
+        return;
+    }
+
+    for (const auto& change : changes) {
+        entries->erase(std::remove_if(entries->begin(), entries->end(),
+                                      [&](const ManifestEntry& entry) {
+                                          return entry.path == change.path ||
+                                                 is_within(entry.path, change.path);
+                                      }),
+                       entries->end());
+        if (change.removed == false) {
+            // Keep the entries sorted by path, as scanned
+            ManifestEntry entry = make_entry(change.path);
+            const auto it = std::lower_bound(
+                entries->begin(), entries->end(), entry,
+                [](const ManifestEntry& a, const ManifestEntry& b) { return a.path < b.path; });
+            entries->insert(it, std::move(entry));
+        }
+    }
+    write_manifest(file, key, location.exclude, *entries);
+}
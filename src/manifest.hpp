@@ -0,0 +1,77 @@
+#ifndef MANIFEST_HPP_
+#define MANIFEST_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Options of the search for model files.
+struct ScanOptions {
+    // Glob patterns, with `*` and `?`, of file and directory names that are skipped.
+    // Hidden entries and the tinyobjloader submodule, whose test models fail to load, are skipped
+    // by default.
+    std::vector<std::string> exclude{".*", "tinyobjloader"};
+
+    // Walk the tree even if a manifest of it exists
+    bool rescan = false;
+
+    enum class Order {
+        Path,
+        // Smallest files first
+        Size,
+    };
+    Order order = Order::Path;
+};
+
+// Model file listed in a manifest.
+struct ManifestEntry {
+    std::string path;
+    std::uint64_t size;
+    std::int64_t mtime;
+
+    // Estimated numbers of vertex and face statements
+    std::uint64_t vertex_count;
+    std::uint64_t face_count;
+};
+
+// Returns true if the name of the file or directory matches one of the exclusion patterns.
+bool is_excluded(const std::filesystem::path& path, const std::vector<std::string>& exclude);
+
+// Returns true if path lies below dir, comparing the paths lexically.
+bool is_within(const std::filesystem::path& path, const std::filesystem::path& dir);
+
+// Finds the model files under dir recursively, with one thread per hardware thread listing
+// directories and sniffing files.  Symbolic links to directories are not followed.
+std::vector<ManifestEntry> scan_models(const std::filesystem::path& dir,
+                                       const std::vector<std::string>& exclude);
+
+// Returns the model files under dir in the order of the options.
+//
+// They are read from the manifest of dir in manifest_dir if there is one for the same exclusions.
+// Otherwise the tree is scanned and the manifest stored for later launches.  Nothing is stored if
+// manifest_dir is empty.  Files added to the tree later are only found by a rescan.
+std::vector<ManifestEntry> load_manifest(const std::filesystem::path& dir,
+                                         const ScanOptions& options,
+                                         const std::filesystem::path& manifest_dir);
+
+// Where the manifest of a tree is stored, with the exclusions it was scanned with.
+struct ManifestLocation {
+    std::filesystem::path dir;
+    std::vector<std::string> exclude;
+    std::filesystem::path manifest_dir;
+};
+
+// Change of a file in a tree with a stored manifest.
+struct ManifestChange {
+    std::string path;
+    bool removed;
+};
+
+// Updates the entries of the changed files in the stored manifest, in order, reading and writing
+// it once.  The entry of a written file is replaced, and that of a removed file dropped.  A removed
+// directory drops all entries below it.  Does nothing if no manifest is stored, since the next
+// launch scans the tree anyway.  Throws on I/O errors.
+void update_manifest(const ManifestLocation& location, const std::vector<ManifestChange>& changes);
+
+#endif
@@ -0,0 +1,170 @@
+#include "mappedfile.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <ctime>
+
+namespace {
+// Files modified this recently may still be written by another program.  They are read into
+// memory instead of mapped, since reading a mapping of a file truncated meanwhile raises SIGBUS.
+const std::time_t SETTLE_SECONDS = 2;
+
+// Smaller files are read, since mapping them saves nothing
+const size_t MAP_MIN_BYTES = size_t{1} << 20;
+
+// Reads of a file that keeps changing while it is read, before giving up
+const int READ_ATTEMPTS = 3;
+
+bool same_contents(const struct stat& a, const struct stat& b) {
+    return a.st_size == b.st_size && a.st_mtime == b.st_mtime && a.st_ctime == b.st_ctime;
+}
+
+// Reads size bytes from the start of the file.  Returns false if the file got shorter.
+bool read_all(int fd, char* out, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t n = pread(fd, out + done, size - done, static_cast<off_t>(done));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+} // namespace
+#endif
+
+struct MappedFile::Impl {
+    const char* data;
+    size_t size;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    // Contents of files that are read instead of mapped
+    std::unique_ptr<char[]> copy;
+#endif
+
+    Impl(const std::string& path, FileAccess access);
+    ~Impl();
+};
+
+MappedFile::MappedFile(const std::string& path, FileAccess access)
+    : impl(std::make_unique<Impl>(path, access)) {}
+MappedFile::~MappedFile() = default;
+
+const char* MappedFile::data() const { return impl->data; }
+size_t MappedFile::size() const { return impl->size; }
+
+#ifdef _WIN32
+MappedFile::Impl::Impl(const std::string& path, FileAccess)
+    : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) == FALSE) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to get size of " + path);
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+    if (size == 0) {
+        return;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map " + path);
+    }
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map " + path);
+    }
+}
+
+MappedFile::Impl::~Impl() {
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+}
+#else
+MappedFile::Impl::Impl(const std::string& path, FileAccess access)
+    : data(nullptr), size(0), copy() {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw std::runtime_error("Failed to stat " + path);
+    }
+    size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+
+    if (access == FileAccess::Read || size < MAP_MIN_BYTES ||
+        std::time(nullptr) - st.st_mtime < SETTLE_SECONDS) {
+        // Read again until the size and modification time are the same before and after
+        for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+            copy = std::make_unique<char[]>(size);
+            struct stat after;
+            if (read_all(fd, copy.get(), size) && fstat(fd, &after) == 0 &&
+                same_contents(st, after)) {
+                close(fd);
+                data = copy.get();
+                return;
+            }
+            if (fstat(fd, &st) == -1) {
+                break;
+            }
+            size = static_cast<size_t>(st.st_size);
+        }
+        close(fd);
+        throw std::runtime_error("File changed while it was read: " + path);
+    }
+
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping holds its own reference to the file
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        throw std::runtime_error("Failed to map " + path);
+    }
+    madvise(ptr, size, MADV_WILLNEED);
+    data = static_cast<const char*>(ptr);
+}
+
+MappedFile::Impl::~Impl() {
+    if (data != nullptr && copy == nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef MAPPEDFILE_HPP_
+#define MAPPEDFILE_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+using std::size_t;
+
+// How a MappedFile accesses the file.
+enum class FileAccess {
+    // Mapped, unless small or modified in the last few seconds
+    Map,
+    // Read into memory, for files that another program may truncate or rewrite while they are used
+    Read,
+};
+
+// Read-only memory mapping of a whole file.
+//
+// The mapping stays valid until the instance is destructed.
+// Outside Windows, files read with FileAccess::Read, small files and files modified in the last
+// few seconds, which may still be written by another program, are read into memory instead, so
+// that truncating them cannot crash the reader.  Windows does not allow truncating mapped files.
+class MappedFile final {
+  public:
+    // Maps or reads the file at path.
+    // Throws if the file cannot be opened or mapped, or keeps changing while it is read.
+    explicit MappedFile(const std::string& path, FileAccess access = FileAccess::Map);
+    ~MappedFile();
+
+    // Prevent copy and move
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    // Returns the mapped bytes.  May be null if the file is empty.
+    const char* data() const;
+
+    // Returns the size of the file in bytes.
+    size_t size() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "mesh.hpp"
+
+#include <cstring>
+#include <utility>
+
+#include "mappedfile.hpp"
+
+Bytes::Bytes(std::vector<unsigned char> owned)
+    : owned(std::make_shared<const std::vector<unsigned char>>(std::move(owned))), file(),
+      offset(0), length(this->owned->size()) {}
+
+Bytes::Bytes(std::shared_ptr<const MappedFile> file, size_t offset, size_t size)
+    : owned(), file(std::move(file)), offset(offset), length(size) {}
+
+const unsigned char* Bytes::data() const {
+    if (file) {
+        return reinterpret_cast<const unsigned char*>(file->data()) + offset;
+    }
+    return owned ? owned->data() : nullptr;
+}
+
+size_t Bytes::size() const { return length; }
+
+void read_vertices(const Mesh& mesh, size_t first, size_t count, unsigned char* dst) {
+    if (mesh.pack_vertices) {
+        mesh.pack_vertices(first, count, dst);
+        return;
+    }
+    const size_t stride = vertex_size(mesh.format);
+    std::memcpy(dst, mesh.vertices.data() + first * stride, count * stride);
+}
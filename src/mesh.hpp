@@ -0,0 +1,85 @@
+#ifndef MESH_HPP_
+#define MESH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "vertex.hpp"
+
+using std::size_t;
+
+class MappedFile;
+
+// Read-only bytes, either owned or borrowed from a memory-mapped file kept alive by this object.
+// Copies share the bytes.
+class Bytes final {
+  public:
+    Bytes() = default;
+    explicit Bytes(std::vector<unsigned char> owned);
+    Bytes(std::shared_ptr<const MappedFile> file, size_t offset, size_t size);
+
+    const unsigned char* data() const;
+    size_t size() const;
+
+  private:
+    std::shared_ptr<const std::vector<unsigned char>> owned;
+    std::shared_ptr<const MappedFile> file;
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+// Contiguous part of a mesh, such as one object of a multi-object file.
+// Counted in indices, or in vertices for meshes drawn without indices.
+struct DrawRange {
+    std::uint32_t first;
+    std::uint32_t count;
+};
+
+// Cluster of nearby triangles of an indexed mesh, culled as a whole.
+struct Meshlet {
+    // Indices of the triangles in the element buffer
+    std::uint32_t first;
+    std::uint32_t count;
+
+    // Bounding sphere in model space
+    float center[3];
+    float radius;
+
+    // All triangle normals lie within the cone around the axis whose half-angle has the sine
+    // cone_cutoff.  The cutoff is 1 when the normals spread too far for the cone to cull anything.
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+// CPU-side mesh in the exact layout of the GPU buffers.
+struct Mesh {
+    // Interleaved vertex buffer contents.  Empty if the vertices are packed on demand instead.
+    VertexFormat format = VertexFormat::Float;
+    size_t vertex_count = 0;
+    Bytes vertices;
+
+    // If set, packs the vertices [first, first + count) to dst in place of the contents of
+    // vertices, so that freshly built meshes are written straight into mapped GPU memory without a
+    // staging copy.  May be called concurrently on disjoint ranges.
+    std::function<void(size_t first, size_t count, unsigned char* dst)> pack_vertices;
+
+    // Element buffer contents, with 2 or 4 bytes per index.
+    // The index size is 0 for meshes drawn without indices.
+    size_t index_size = 0;
+    size_t index_count = 0;
+    Bytes indices;
+
+    // One range per shape of the model file, in file order
+    std::vector<DrawRange> ranges;
+
+    // Clusters covering the ranges in order, if built
+    std::vector<Meshlet> meshlets;
+};
+
+// Writes the packed vertices [first, first + count) of the mesh to dst.
+void read_vertices(const Mesh& mesh, size_t first, size_t count, unsigned char* dst);
+
+#endif
@@ -0,0 +1,250 @@
+#include "meshcache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "hash.hpp"
+#include "mappedfile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Bump whenever the layout of the file or of the cached buffers changes
+const std::uint32_t CACHE_VERSION = 3;
+const char CACHE_MAGIC[8] = {'C', 'G', '1', 'M', 'E', 'S', 'H', '\0'};
+
+// Sections are aligned so that they can be read in place
+const std::uint64_t SECTION_ALIGNMENT = 64;
+
+// Vertices written at a time, so that vertices packed on demand never need a full staging copy
+const size_t WRITE_CHUNK_VERTICES = 1 << 16;
+
+long process_id() {
+#ifdef _WIN32
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(getpid());
+#endif
+}
+
+// Fixed-size header at the start of each cache file, followed by the source path and the sections.
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t path_length;
+
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    std::uint64_t source_hash;
+    std::uint64_t variant;
+
+    std::uint32_t format;
+    std::uint32_t index_size;
+    std::uint64_t vertex_count;
+    std::uint64_t index_count;
+
+    std::uint64_t vertex_offset;
+    std::uint64_t vertex_bytes;
+    std::uint64_t index_offset;
+    std::uint64_t index_bytes;
+    std::uint64_t range_offset;
+    std::uint64_t range_count;
+    std::uint64_t meshlet_offset;
+    std::uint64_t meshlet_count;
+};
+
+std::uint64_t align_up(std::uint64_t value) {
+    return (value + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+std::int64_t mtime_of(const fs::path& path) {
+    return static_cast<std::int64_t>(fs::last_write_time(path).time_since_epoch().count());
+}
+
+// Returns the value of the environment variable, or nothing if it is unset or empty
+std::optional<fs::path> env_path(const char* name) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || value[0] == '\0') {
+        return std::nullopt;
+    }
+    return fs::path(value);
+}
+} // namespace
+
+SourceKey source_key(const std::string& path, std::uint64_t variant) {
+    return SourceKey{fs::canonical(path).string(), fs::file_size(path), mtime_of(path), variant};
+}
+
+std::uint64_t source_hash(const std::string& path, FileAccess access) {
+    const MappedFile file{path, access};
+    return hash_bytes_parallel(file.data(), file.size());
+}
+
+MeshCache::MeshCache(fs::path dir) : dir(std::move(dir)) { fs::create_directories(this->dir); }
+
+fs::path MeshCache::default_dir() {
+#ifdef _WIN32
+    if (auto local = env_path("LOCALAPPDATA")) {
+        return *local / "cg1" / "cache";
+    }
+#else
+    if (auto xdg = env_path("XDG_CACHE_HOME")) {
+        return *xdg / "cg1";
+    }
+    if (auto home = env_path("HOME")) {
+        return *home / ".cache" / "cg1";
+    }
+#endif
+    return fs::temp_directory_path() / "cg1";
+}
+
+fs::path MeshCache::entry_path(const SourceKey& key) const {
+    // Different options of the same file get different entries
+    const std::uint64_t name = hash_bytes(key.path.data(), key.path.size(), key.variant);
+    std::ostringstream filename;
+    filename << std::hex << std::setw(16) << std::setfill('0') << name << ".meshcache";
+    return dir / filename.str();
+}
+
+std::optional<Mesh> MeshCache::load(const SourceKey& key, FileAccess access) const {
+    const fs::path path = entry_path(key);
+    std::error_code ec;
+    if (fs::is_regular_file(path, ec) == false) {
+        return std::nullopt;
+    }
+
+    auto file = std::make_shared<const MappedFile>(path.string());
+    if (file->size() < sizeof(Header)) {
+        return std::nullopt;
+    }
+    Header header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    const bool matches = std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+                         header.version == CACHE_VERSION && header.variant == key.variant &&
+                         header.source_size == key.size && header.path_length == key.path.size();
+    if (matches == false) {
+        return std::nullopt;
+    }
+
+    // Guard against name collisions and truncated files
+    const char* stored_path = file->data() + sizeof(Header);
+    const bool intact =
+        sizeof(Header) + header.path_length <= file->size() &&
+        std::memcmp(stored_path, key.path.data(), key.path.size()) == 0 &&
+        header.vertex_offset + header.vertex_bytes <= file->size() &&
+        header.index_offset + header.index_bytes <= file->size() &&
+        header.range_offset + header.range_count * sizeof(DrawRange) <= file->size() &&
+        header.meshlet_offset + header.meshlet_count * sizeof(Meshlet) <= file->size() &&
+        header.format <= static_cast<std::uint32_t>(VertexFormat::Compact) &&
+        header.vertex_bytes ==
+            header.vertex_count * vertex_size(static_cast<VertexFormat>(header.format)) &&
+        header.index_bytes == header.index_count * header.index_size;
+    if (intact == false) {
+        return std::nullopt;
+    }
+    // Only a changed modification time costs a read of the whole source
+    if (header.source_mtime != key.mtime && header.source_hash != source_hash(key.path, access)) {
+        return std::nullopt;
+    }
+
+    Mesh mesh;
+    mesh.format = static_cast<VertexFormat>(header.format);
+    mesh.vertex_count = header.vertex_count;
+    mesh.vertices = Bytes(file, header.vertex_offset, header.vertex_bytes);
+    mesh.index_size = header.index_size;
+    mesh.index_count = header.index_count;
+    mesh.indices = Bytes(file, header.index_offset, header.index_bytes);
+    mesh.ranges.resize(header.range_count);
+    std::memcpy(mesh.ranges.data(), file->data() + header.range_offset,
+                header.range_count * sizeof(DrawRange));
+    mesh.meshlets.resize(header.meshlet_count);
+    std::memcpy(mesh.meshlets.data(), file->data() + header.meshlet_offset,
+                header.meshlet_count * sizeof(Meshlet));
+    return mesh;
+}
+
+void MeshCache::store(const SourceKey& key, std::uint64_t hash, const Mesh& mesh) const {
+    Header header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.path_length = static_cast<std::uint32_t>(key.path.size());
+    header.source_size = key.size;
+    header.source_mtime = key.mtime;
+    header.source_hash = hash;
+    header.variant = key.variant;
+    header.format = static_cast<std::uint32_t>(mesh.format);
+    header.index_size = static_cast<std::uint32_t>(mesh.index_size);
+    header.vertex_count = mesh.vertex_count;
+    header.index_count = mesh.index_count;
+    header.vertex_offset = align_up(sizeof(Header) + key.path.size());
+    header.vertex_bytes = mesh.vertex_count * vertex_size(mesh.format);
+    header.index_offset = align_up(header.vertex_offset + header.vertex_bytes);
+    header.index_bytes = mesh.indices.size();
+    header.range_offset = align_up(header.index_offset + header.index_bytes);
+    header.range_count = mesh.ranges.size();
+    header.meshlet_offset = align_up(header.range_offset + header.range_count * sizeof(DrawRange));
+    header.meshlet_count = mesh.meshlets.size();
+
+    // Write to a temporary file first, so that readers never see a partial entry.  The name is
+    // unique to the process and thread, since other viewers may share the cache directory.
+    const fs::path path = entry_path(key);
+    std::ostringstream suffix;
+    suffix << ".tmp" << process_id() << "-"
+           << std::hash<std::thread::id>{}(std::this_thread::get_id());
+    fs::path tmp = path;
+    tmp += suffix.str();
+
+    {
+        std::ofstream out{tmp, std::ios::binary | std::ios::trunc};
+        const auto pad_to = [&](std::uint64_t offset) {
+            const std::streamoff pos = out.tellp();
+            if (pos < 0) {
+                return;
+            }
+            const std::string padding(offset - static_cast<std::uint64_t>(pos), '\0');
+            out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(key.path.data(), static_cast<std::streamsize>(key.path.size()));
+        pad_to(header.vertex_offset);
+        std::vector<unsigned char> chunk;
+        for (size_t first = 0; first < mesh.vertex_count; first += WRITE_CHUNK_VERTICES) {
+            const size_t count = std::min(WRITE_CHUNK_VERTICES, mesh.vertex_count - first);
+            chunk.resize(count * vertex_size(mesh.format));
+            read_vertices(mesh, first, count, chunk.data());
+            out.write(reinterpret_cast<const char*>(chunk.data()),
+                      static_cast<std::streamsize>(chunk.size()));
+        }
+        pad_to(header.index_offset);
+        out.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                  static_cast<std::streamsize>(mesh.indices.size()));
+        pad_to(header.range_offset);
+        out.write(reinterpret_cast<const char*>(mesh.ranges.data()),
+                  static_cast<std::streamsize>(mesh.ranges.size() * sizeof(DrawRange)));
+        pad_to(header.meshlet_offset);
+        out.write(reinterpret_cast<const char*>(mesh.meshlets.data()),
+                  static_cast<std::streamsize>(mesh.meshlets.size() * sizeof(Meshlet)));
+        if (out.good() == false) {
+            out.close();
+            fs::remove(tmp);
+            throw std::runtime_error("Failed to write mesh cache " + tmp.string());
+        }
+    }
+    fs::rename(tmp, path);
+}
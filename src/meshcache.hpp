@@ -0,0 +1,58 @@
+#ifndef MESHCACHE_HPP_
+#define MESHCACHE_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+
+// Identity of a model file and of the options its mesh is built with, taken without reading the
+// file.
+struct SourceKey {
+    std::string path;
+    std::uint64_t size;
+    std::int64_t mtime;
+
+    // Fingerprint of the options that affect the built mesh
+    std::uint64_t variant;
+};
+
+// Computes the key of the file at path from its canonical path, size and modification time.
+// Throws if the file does not exist.
+SourceKey source_key(const std::string& path, std::uint64_t variant);
+
+// Hashes the whole contents of the file at path.
+// Throws if the file cannot be read.
+std::uint64_t source_hash(const std::string& path, FileAccess access = FileAccess::Map);
+
+// On-disk cache of preprocessed meshes, one `.meshcache` file per model.
+//
+// Cached buffers are memory-mapped on load, so that they are handed to the GL without any copy
+// on the CPU side.
+class MeshCache final {
+  public:
+    // Uses dir as the cache directory, creating it if needed.
+    explicit MeshCache(std::filesystem::path dir);
+
+    // Returns $XDG_CACHE_HOME/cg1 or its platform equivalent.
+    static std::filesystem::path default_dir();
+
+    // Returns the cached mesh for key, or nothing if there is no valid entry.
+    // An entry whose source has the same size but another modification time, as after a touch or
+    // a checkout, is only used if the contents still have the stored hash, read with access.
+    std::optional<Mesh> load(const SourceKey& key, FileAccess access = FileAccess::Map) const;
+
+    // Stores the mesh for key along with the hash of the source contents, replacing the existing
+    // entry atomically.  Throws on I/O errors.
+    void store(const SourceKey& key, std::uint64_t hash, const Mesh& mesh) const;
+
+  private:
+    std::filesystem::path dir;
+
+    std::filesystem::path entry_path(const SourceKey& key) const;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "vector.hpp"
+
+namespace {
+// Normal cones wider than this cosine of their half-angle are not worth testing
+const float MIN_CONE_COSINE = 0.1f;
+
+using Vec3 = std::array<float, 3>;
+
+Vec3 position_of(const float* positions, std::uint32_t v) {
+    return {positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]};
+}
+
+float dot(const Vec3& a, const Vec3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+// Fills the bounding sphere and normal cone of the triangles
+void compute_bounds(Meshlet& meshlet, const std::uint32_t* triangles, const float* positions) {
+    Vec3 low = position_of(positions, triangles[0]);
+    Vec3 high = low;
+    for (size_t i = 0; i < meshlet.count; i++) {
+        const Vec3 p = position_of(positions, triangles[i]);
+        for (int a = 0; a < 3; a++) {
+            low[a] = std::min(low[a], p[a]);
+            high[a] = std::max(high[a], p[a]);
+        }
+    }
+    const Vec3 center{(low[0] + high[0]) / 2, (low[1] + high[1]) / 2, (low[2] + high[2]) / 2};
+    float radius = 0;
+    for (size_t i = 0; i < meshlet.count; i++) {
+        const Vec3 p = position_of(positions, triangles[i]);
+        const Vec3 d{p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+        radius = std::max(radius, std::sqrt(dot(d, d)));
+    }
+
+    std::vector<Vec3> normals;
+    Vec3 axis{0, 0, 0};
+    for (size_t i = 0; i + 2 < meshlet.count; i += 3) {
+        const Vec3 p0 = position_of(positions, triangles[i]);
+        const Vec3 p1 = position_of(positions, triangles[i + 1]);
+        const Vec3 p2 = position_of(positions, triangles[i + 2]);
+        const Vec3 e1{p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const Vec3 e2{p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        const Vec3 n{e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                     e1[0] * e2[1] - e1[1] * e2[0]};
+        const float n_length = std::sqrt(dot(n, n));
+        if (n_length == 0) {
+            continue;
+        }
+        normals.push_back(Vec3{n[0] / n_length, n[1] / n_length, n[2] / n_length});
+        for (int a = 0; a < 3; a++) {
+            axis[a] += normals.back()[a];
+        }
+    }
+
+    float cone_cosine = -1;
+    const float axis_length = std::sqrt(dot(axis, axis));
+    if (axis_length > 0) {
+        for (int a = 0; a < 3; a++) {
+            axis[a] /= axis_length;
+        }
+        cone_cosine = 1;
+        for (const auto& n : normals) {
+            cone_cosine = std::min(cone_cosine, dot(axis, n));
+        }
+    }
+
+    std::copy(center.begin(), center.end(), meshlet.center);
+    meshlet.radius = radius;
+    std::copy(axis.begin(), axis.end(), meshlet.cone_axis);
+    meshlet.cone_cutoff =
+        cone_cosine < MIN_CONE_COSINE ? 1 : std::sqrt(1 - cone_cosine * cone_cosine);
+}
+} // namespace
+
+std::vector<Meshlet> build_meshlets(std::uint32_t* indices, size_t index_count,
+                                    const std::vector<DrawRange>& ranges, const float* positions,
+                                    size_t vertex_count) {
+    // Triangles around each vertex
+    std::vector<std::uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t i = 0; i < index_count; i++) {
+        offsets[indices[i] + 1]++;
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<std::uint32_t> adjacency(index_count);
+    {
+        std::vector<std::uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < index_count; i++) {
+            adjacency[cursor[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<Meshlet> meshlets;
+    std::vector<bool> assigned(index_count / 3, false);
+    std::vector<std::uint32_t> queue;
+    std::vector<std::uint32_t> reordered;
+    for (const auto& range : ranges) {
+        const std::uint32_t first_triangle = range.first / 3;
+        const std::uint32_t end_triangle = (range.first + range.count) / 3;
+        reordered.clear();
+
+        // Grow each meshlet breadth-first over triangles sharing a vertex, so that it stays compact
+        for (std::uint32_t seed = first_triangle; seed < end_triangle; seed++) {
+            if (assigned[seed]) {
+                continue;
+            }
+            Meshlet meshlet{};
+            meshlet.first = static_cast<std::uint32_t>(range.first + reordered.size());
+
+            queue.assign(1, seed);
+            assigned[seed] = true;
+            for (size_t head = 0; head < queue.size(); head++) {
+                const std::uint32_t* triangle = &indices[3 * queue[head]];
+                for (int j = 0; j < 3; j++) {
+                    const std::uint32_t v = triangle[j];
+                    for (std::uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+                        const std::uint32_t t = adjacency[k];
+                        if (queue.size() < MAX_MESHLET_TRIANGLES && t >= first_triangle &&
+                            t < end_triangle && assigned[t] == false) {
+                            assigned[t] = true;
+                            queue.push_back(t);
+                        }
+                    }
+                }
+            }
+
+            for (const std::uint32_t t : queue) {
+                reordered.insert(reordered.end(), &indices[3 * t], &indices[3 * t + 3]);
+            }
+            meshlet.count = static_cast<std::uint32_t>(3 * queue.size());
+            compute_bounds(meshlet, &reordered[meshlet.first - range.first], positions);
+            meshlets.push_back(meshlet);
+        }
+
+        std::copy(reordered.begin(), reordered.end(), indices + range.first);
+    }
+    return meshlets;
+}
+
+CullView cull_view(const Matrix4& mvp) {
+    CullView view{};
+
+    // Each clip plane is the last row of the matrix plus or minus one of the others
+    const int signs[6][2] = {{0, 1}, {0, -1}, {1, 1}, {1, -1}, {2, 1}, {2, -1}};
+    for (int p = 0; p < 6; p++) {
+        const int row = signs[p][0];
+        const float sign = static_cast<float>(signs[p][1]);
+        float* plane = view.planes[p];
+        for (int c = 0; c < 4; c++) {
+            plane[c] = mvp[12 + c] + sign * mvp[4 * row + c];
+        }
+        const float length =
+            std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0) {
+            for (int c = 0; c < 4; c++) {
+                plane[c] /= length;
+            }
+        }
+    }
+
+    // The camera is the clip space point at infinity along -z.  With OpenGL projections this
+    // maps back to a positive w for perspective and to w = 0 for orthographic ones.
+    Matrix4 inverse = mvp;
+    inverse.invert();
+    const Vector4 eye = inverse * Vector4(0, 0, -1, 0);
+    view.eye[0] = eye.x;
+    view.eye[1] = eye.y;
+    view.eye[2] = eye.z;
+    view.eye[3] = eye.w;
+    return view;
+}
+
+bool meshlet_visible(const Meshlet& meshlet, const CullView& view, bool cull_backfaces) {
+    const float* c = meshlet.center;
+    for (const auto& plane : view.planes) {
+        if (plane[0] * c[0] + plane[1] * c[1] + plane[2] * c[2] + plane[3] < -meshlet.radius) {
+            return false;
+        }
+    }
+
+    if (cull_backfaces && meshlet.cone_cutoff < 1) {
+        // Direction from the center to the camera, scaled by the positive eye w
+        const Vec3 to_eye{view.eye[0] - c[0] * view.eye[3], view.eye[1] - c[1] * view.eye[3],
+                          view.eye[2] - c[2] * view.eye[3]};
+        const Vec3 axis{meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2]};
+        if (-dot(to_eye, axis) >=
+            meshlet.cone_cutoff * std::sqrt(dot(to_eye, to_eye)) + meshlet.radius * view.eye[3]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef MESHLET_HPP_
+#define MESHLET_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "matrix.hpp"
+#include "mesh.hpp"
+
+using std::size_t;
+
+// Upper bound of the number of triangles in one meshlet.
+const size_t MAX_MESHLET_TRIANGLES = 128;
+
+// Splits the triangles of each range into meshlets of connected, nearby triangles, and reorders the
+// indices so that every meshlet is contiguous.  Triangles never move across ranges.
+// Positions holds three floats per vertex.
+std::vector<Meshlet> build_meshlets(std::uint32_t* indices, size_t index_count,
+                                    const std::vector<DrawRange>& ranges, const float* positions,
+                                    size_t vertex_count);
+
+// View volume and camera, in the model space of a model-view-projection matrix.
+struct CullView {
+    // Frustum planes (a, b, c, d) with normals pointing inwards, normalized so that
+    // a x + b y + c z + d is the distance to the plane
+    float planes[6][4];
+
+    // Homogeneous camera position: a point for perspective projections, or the direction
+    // towards the camera with w = 0 for orthographic ones
+    float eye[4];
+};
+
+// Extracts the view volume of the matrix.
+CullView cull_view(const Matrix4& mvp);
+
+// Returns false if the meshlet is certainly outside the view volume, or if backfaces are culled
+// and all of its triangles face away from the camera.  Triangles are front-facing when wound
+// counter-clockwise.
+bool meshlet_visible(const Meshlet& meshlet, const CullView& view, bool cull_backfaces);
+
+#endif
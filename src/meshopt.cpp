@@ -0,0 +1,292 @@
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+// A cluster is cut once its running ACMR drops below this factor of the whole patch's ACMR
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+const std::uint32_t UNSET = std::numeric_limits<std::uint32_t>::max();
+
+// FIFO cache simulated with timestamps: a vertex is cached if it was added less than
+// VERTEX_CACHE_SIZE misses ago.
+class CacheSim {
+  public:
+    explicit CacheSim(size_t vertex_count)
+        : stamps(vertex_count, 0), timestamp(VERTEX_CACHE_SIZE + 1) {}
+
+    // Returns the number of misses caused by the triangle
+    unsigned add(const std::uint32_t* triangle) {
+        unsigned misses = 0;
+        for (int j = 0; j < 3; j++) {
+            const std::uint32_t v = triangle[j];
+            if (timestamp - stamps[v] > VERTEX_CACHE_SIZE) {
+                stamps[v] = timestamp++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    // Returns how many misses ago the vertex entered the cache
+    unsigned age(std::uint32_t v) const { return timestamp - stamps[v]; }
+
+    void flush() { timestamp += VERTEX_CACHE_SIZE + 1; }
+
+  private:
+    std::vector<unsigned> stamps;
+    unsigned timestamp;
+};
+
+// Tipsify over a triangle list whose vertices are numbered [0, vertex_count)
+std::vector<std::uint32_t> tipsify(const std::vector<std::uint32_t>& indices, size_t vertex_count) {
+    const size_t face_count = indices.size() / 3;
+
+    // Triangles adjacent to each vertex, and how many of them are not emitted yet
+    std::vector<std::uint32_t> live(vertex_count, 0);
+    for (const std::uint32_t v : indices) {
+        live[v]++;
+    }
+    std::vector<std::uint32_t> offsets(vertex_count + 1, 0);
+    std::partial_sum(live.begin(), live.end(), offsets.begin() + 1);
+    std::vector<std::uint32_t> adjacency(indices.size());
+    {
+        std::vector<std::uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[cursor[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+
+    CacheSim cache{vertex_count};
+    std::vector<bool> emitted(face_count, false);
+    std::vector<std::uint32_t> dead_ends;
+    std::vector<std::uint32_t> candidates;
+    std::vector<std::uint32_t> out;
+    out.reserve(indices.size());
+    size_t scan = 0;
+
+    // Picks a vertex with live triangles from the dead-end stack, or the next one in input order
+    const auto skip_dead_end = [&]() -> long {
+        while (dead_ends.empty() == false) {
+            const std::uint32_t v = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[v] > 0) {
+                return v;
+            }
+        }
+        for (; scan < vertex_count; scan++) {
+            if (live[scan] > 0) {
+                return static_cast<long>(scan);
+            }
+        }
+        return -1;
+    };
+
+    long fan = skip_dead_end();
+    while (fan >= 0) {
+        // Emit all remaining triangles around the fanning vertex
+        candidates.clear();
+        for (std::uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++) {
+            const std::uint32_t t = adjacency[k];
+            if (emitted[t]) {
+                continue;
+            }
+            const std::uint32_t* triangle = &indices[3 * t];
+            for (int j = 0; j < 3; j++) {
+                out.push_back(triangle[j]);
+                dead_ends.push_back(triangle[j]);
+                candidates.push_back(triangle[j]);
+                live[triangle[j]]--;
+            }
+            cache.add(triangle);
+            emitted[t] = true;
+        }
+
+        // Prefer the oldest candidate that will still be cached after emitting its triangles
+        long best = -1;
+        long best_priority = -1;
+        for (const std::uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            long priority = 0;
+            if (cache.age(v) + 2 * live[v] <= VERTEX_CACHE_SIZE) {
+                priority = cache.age(v);
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+        fan = best >= 0 ? best : skip_dead_end();
+    }
+    return out;
+}
+
+// Splits the cache-optimized triangle list into clusters, returned as starting triangle indices
+std::vector<size_t> cluster_boundaries(const std::vector<std::uint32_t>& indices,
+                                       size_t vertex_count) {
+    const size_t face_count = indices.size() / 3;
+
+    // Triangles missing all three vertices usually start a new patch
+    std::vector<size_t> hard;
+    {
+        CacheSim cache{vertex_count};
+        for (size_t t = 0; t < face_count; t++) {
+            if (cache.add(&indices[3 * t]) == 3 || t == 0) {
+                hard.push_back(t);
+            }
+        }
+    }
+    hard.push_back(face_count);
+
+    // Cut patches further wherever the running ACMR is close to the patch's ACMR
+    std::vector<size_t> soft;
+    CacheSim cache{vertex_count};
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        const size_t begin = hard[h], end = hard[h + 1];
+
+        cache.flush();
+        unsigned patch_misses = 0;
+        for (size_t t = begin; t < end; t++) {
+            patch_misses += cache.add(&indices[3 * t]);
+        }
+        const float target = OVERDRAW_THRESHOLD * static_cast<float>(patch_misses) /
+                             static_cast<float>(end - begin);
+
+        soft.push_back(begin);
+        cache.flush();
+        unsigned misses = 0, faces = 0;
+        for (size_t t = begin; t < end; t++) {
+            misses += cache.add(&indices[3 * t]);
+            faces++;
+            if (t + 1 < end && static_cast<float>(misses) / static_cast<float>(faces) <= target) {
+                soft.push_back(t + 1);
+                cache.flush();
+                misses = faces = 0;
+            }
+        }
+    }
+    soft.push_back(face_count);
+    return soft;
+}
+
+std::array<float, 3> position_of(const float* positions, std::uint32_t v) {
+    return {positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]};
+}
+
+// Orders clusters so that the ones facing away from the mesh center are drawn first, since they
+// are likely to occlude the rest.  Local vertex v lives at positions[to_global[v]].
+void sort_clusters(std::vector<std::uint32_t>& indices, const std::vector<size_t>& boundaries,
+                   const std::vector<std::uint32_t>& to_global, const float* positions) {
+    std::array<float, 3> mesh_center{0, 0, 0};
+    for (const std::uint32_t v : indices) {
+        const auto p = position_of(positions, to_global[v]);
+        for (int a = 0; a < 3; a++) {
+            mesh_center[a] += p[a] / static_cast<float>(indices.size());
+        }
+    }
+
+    const size_t cluster_count = boundaries.size() - 1;
+    std::vector<float> keys(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) {
+        std::array<float, 3> center{0, 0, 0}, normal{0, 0, 0};
+        float area_sum = 0;
+        for (size_t t = boundaries[c]; t < boundaries[c + 1]; t++) {
+            const auto p0 = position_of(positions, to_global[indices[3 * t]]);
+            const auto p1 = position_of(positions, to_global[indices[3 * t + 1]]);
+            const auto p2 = position_of(positions, to_global[indices[3 * t + 2]]);
+            const std::array<float, 3> e1{p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const std::array<float, 3> e2{p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            const std::array<float, 3> n{e1[1] * e2[2] - e1[2] * e2[1],
+                                         e1[2] * e2[0] - e1[0] * e2[2],
+                                         e1[0] * e2[1] - e1[1] * e2[0]};
+            const float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int a = 0; a < 3; a++) {
+                center[a] += (p0[a] + p1[a] + p2[a]) * (area / 3);
+                normal[a] += n[a];
+            }
+            area_sum += area;
+        }
+
+        const float inv_area = area_sum > 0 ? 1 / area_sum : 0;
+        const float normal_length =
+            std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        const float inv_normal = normal_length > 0 ? 1 / normal_length : 0;
+        float key = 0;
+        for (int a = 0; a < 3; a++) {
+            key += (center[a] * inv_area - mesh_center[a]) * normal[a] * inv_normal;
+        }
+        keys[c] = key;
+    }
+
+    std::vector<size_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<std::uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (const size_t c : order) {
+        sorted.insert(sorted.end(), indices.begin() + 3 * boundaries[c],
+                      indices.begin() + 3 * boundaries[c + 1]);
+    }
+    indices.swap(sorted);
+}
+} // namespace
+
+double acmr(const std::uint32_t* indices, size_t index_count, size_t vertex_count) {
+    if (index_count < 3) {
+        return 0;
+    }
+    CacheSim cache{vertex_count};
+    size_t misses = 0;
+    for (size_t i = 0; i + 2 < index_count; i += 3) {
+        misses += cache.add(indices + i);
+    }
+    return static_cast<double>(misses) / static_cast<double>(index_count / 3);
+}
+
+OptimizeStats optimize_triangles(std::uint32_t* indices, size_t index_count,
+                                 const std::vector<DrawRange>& ranges, const float* positions,
+                                 size_t vertex_count) {
+    OptimizeStats stats{};
+    stats.acmr_before = acmr(indices, index_count, vertex_count);
+
+    // Each range is renumbered densely, so that its work does not scale with the whole mesh
+    std::vector<std::uint32_t> local_of(vertex_count, UNSET);
+    std::vector<std::uint32_t> to_global;
+    std::vector<std::uint32_t> local;
+    for (const auto& range : ranges) {
+        local.clear();
+        to_global.clear();
+        for (size_t i = range.first; i < range.first + range.count; i++) {
+            const std::uint32_t v = indices[i];
+            if (local_of[v] == UNSET) {
+                local_of[v] = static_cast<std::uint32_t>(to_global.size());
+                to_global.push_back(v);
+            }
+            local.push_back(local_of[v]);
+        }
+
+        std::vector<std::uint32_t> ordered = tipsify(local, to_global.size());
+        if (ordered.empty() == false) {
+            sort_clusters(ordered, cluster_boundaries(ordered, to_global.size()), to_global,
+                          positions);
+        }
+        for (size_t i = 0; i < ordered.size(); i++) {
+            indices[range.first + i] = to_global[ordered[i]];
+        }
+
+        for (const std::uint32_t v : to_global) {
+            local_of[v] = UNSET;
+        }
+    }
+
+    stats.acmr_after = acmr(indices, index_count, vertex_count);
+    return stats;
+}
@@ -0,0 +1,35 @@
+#ifndef MESHOPT_HPP_
+#define MESHOPT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+
+using std::size_t;
+
+// Size of the simulated FIFO post-transform vertex cache.
+const size_t VERTEX_CACHE_SIZE = 16;
+
+// Average cache miss ratio: vertices transformed per triangle with a FIFO cache of
+// VERTEX_CACHE_SIZE entries.  Ranges from 0.5 (ideal) to 3 (no reuse).
+double acmr(const std::uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// ACMR of a triangle list before and after optimize_triangles.
+struct OptimizeStats {
+    double acmr_before;
+    double acmr_after;
+};
+
+// Reorders the triangles inside each range of indices for the post-transform vertex cache
+// (Tipsify, Sander et al. 2007), then reorders clusters of them so that outward-facing
+// clusters come first, which reduces overdraw.
+// Triangles never move across ranges.  Positions holds three floats per vertex.
+//
+// Vertex order is not touched; ordering vertices by first use afterwards improves fetch locality.
+OptimizeStats optimize_triangles(std::uint32_t* indices, size_t index_count,
+                                 const std::vector<DrawRange>& ranges, const float* positions,
+                                 size_t vertex_count);
+
+#endif
@@ -1,10 +1,22 @@
 #include "model.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
+#include <future>
 #include <iostream>
 #include <limits>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -12,11 +24,152 @@
 #include <glad/glad.h>
 #include <tinyobjloader/tiny_obj_loader.h>
 
+#include "bounds.hpp"
+#include "glstate.hpp"
+#include "instanced.hpp"
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+#include "meshcache.hpp"
+#include "meshlet.hpp"
+#include "meshopt.hpp"
+#include "objreader.hpp"
+#include "occlusion.hpp"
+#include "simplify.hpp"
+#include "threadpool.hpp"
+#include "vertex.hpp"
+
+namespace fs = std::filesystem;
+
 namespace {
-void normalize(tinyobj::attrib_t* attrib, std::vector<GLfloat>& vertices,
-               std::vector<GLfloat>& colors, tinyobj::shape_t* shape);
+// Mesh along with the statistics of loading it
+struct LoadedMesh {
+    Mesh mesh;
+    ModelStats stats;
+};
+
+// Triangles of a model read by a streaming task, waiting for upload by the drawing thread
+struct Stream {
+    std::mutex mutex;
+    std::condition_variable space;
+    // Batches of vertices in STREAM_FORMAT
+    std::deque<std::vector<unsigned char>> batches;
+    std::atomic<bool> cancel{false};
+};
+
+// Parse of a prefetched model, which may be queued again to move it ahead in the pool, and only
+// runs on the worker that picks it first
+struct ParseJob {
+    std::packaged_task<LoadedMesh()> task;
+    std::atomic<bool> claimed{false};
+    // Stream of the model while it is parsed, if streaming is enabled, cancelled once the parse
+    // finishes so that it frees its worker without waiting for the drawing thread
+    std::shared_ptr<Stream> stream;
+
+    void run() {
+        if (claimed.exchange(true) == false) {
+            task();
+            if (stream) {
+                stream->cancel = true;
+                stream->space.notify_all();
+            }
+        }
+    }
+};
+LoadedMesh load_mesh(const std::string& path, const ModelOptions& options, FileAccess access,
+                     ThreadPool* pool);
+Mesh build_mesh(const std::string& path, const ModelOptions& options, FileAccess access,
+                ModelStats& stats);
+ObjData read_tinyobj(const std::string& path);
+double normalize(ObjData* obj);
+void optimize(ObjData* obj, const std::vector<DrawRange>& ranges);
+std::vector<Meshlet> split_meshlets(ObjData* obj, const std::vector<DrawRange>& ranges);
+void expand(ObjData&& obj, Mesh& data);
+void deduplicate(ObjData&& obj, Mesh& data);
+
+// Index buffer holding every level of detail of a mesh
+struct LodChain {
+    std::vector<unsigned char> indices;
+    // Ranges of the levels in indices, from finest to coarsest
+    std::vector<DrawRange> levels;
+
+    // Coarse copy of the mesh for the software occlusion buffer, if requested
+    std::shared_ptr<const Occluder> occluder;
+};
+LodChain build_lods(const Mesh& mesh, const std::string& path, bool levels, bool occluder);
+
+// Fractions of the triangles kept by each level of detail
+const std::vector<float> LOD_RATIOS{0.5f, 0.25f, 0.1f, 0.02f};
+
+// Meshes with fewer triangles are cheap enough to always draw in full
+const size_t MIN_LOD_TRIANGLES = 1 << 14;
+
+// Triangles per pixel covered by the model that a level of detail must keep to be drawn
+const float TRIANGLES_PER_PIXEL = 1.0f;
+
+// Occluders are simplified down to about this many triangles, which keeps drawing dozens of them
+// into the occlusion buffer well within a millisecond
+const size_t OCCLUDER_TRIANGLES = 512;
+
+// Resolution of the software depth buffer instances are culled against
+const size_t OCCLUSION_WIDTH = 320;
+const size_t OCCLUSION_HEIGHT = 180;
+
+// Files at least this large are streamed in while they load, when streaming is enabled
+const std::uintmax_t STREAM_MIN_BYTES = std::uintmax_t{64} << 20;
+
+// Triangles parsed between uploads of a stream
+const size_t STREAM_BATCH_TRIANGLES = 1 << 16;
+
+// Batches parsed ahead of the upload, so that a stream of a model that is not shown stalls
+const size_t STREAM_MAX_QUEUED_BATCHES = 16;
+
+// Bytes of streamed triangles uploaded in one frame at most, to keep frames short
+const size_t STREAM_UPLOAD_PER_FRAME = size_t{64} << 20;
+
+// Lines probed for the bounding box that streamed triangles are normalized with
+const size_t STREAM_BOUNDS_SAMPLES = 1 << 12;
+
+// Streamed positions are not clamped, since the sampled bounding box may not contain them all
+const VertexFormat STREAM_FORMAT = VertexFormat::Float;
+
+void stream_batches(Stream& stream, const std::string& path);
+
+// Milliseconds elapsed since start
+double elapsed_ms(std::chrono::steady_clock::time_point start);
+
+// Writes the bytes to the buffer bound to target, reallocating its storage only if the size
+// changes.  Returns true if the storage was reused.
+bool write_buffer(GLenum target, size_t& size, const Bytes& bytes);
+// Same for the vertices of the mesh and the buffer bound to GL_ARRAY_BUFFER
+bool write_vertex_buffer(const Mesh& data, size_t& size);
+
+// Vertices packed at a time when a buffer cannot be mapped, or when reading them back
+const size_t PACK_CHUNK_VERTICES = 1 << 16;
+
+// Vertices packed by one thread at least when packing into a mapped buffer
+const size_t MIN_PACK_VERTICES_PER_THREAD = 1 << 18;
+
+// Writes the string as a JSON string literal
+void print_json_string(std::ostream& out, const std::string& value);
+
+// Changes of model files waiting to be stored in a tracked manifest by a task on the pool
+struct ManifestUpdates {
+    ManifestLocation location;
+
+    std::mutex mutex;
+    std::vector<ManifestChange> pending;
+    // Whether a task to store the pending changes is queued or running
+    bool scheduled = false;
+
+    // Held while the manifest is rewritten, so that updates do not overlap
+    std::mutex writing;
+};
+// Stores the pending changes in the manifest until there are none, logging failures
+void store_manifest_changes(ManifestUpdates& updates);
+
 enum class LoadStatus {
     NotYet,
+    Parsing,
     Loaded,
     Failed,
 };
@@ -24,15 +177,78 @@ enum class LoadStatus {
 
 struct Model::Impl {
     std::string path;
+    ModelOptions options;
 
     mutable LoadStatus status;
+    mutable std::future<LoadedMesh> parsed;
+    // Queued parse of parsed, until the parse finishes
+    mutable std::shared_ptr<ParseJob> parse_job;
+
+    // Parse of the changed model file, swapped in by the first draw after it finishes
+    mutable std::future<LoadedMesh> reloaded;
+    // Whether the file changed since the running parse started
+    mutable bool reload_pending;
+    // Files that changed while the viewer runs may be rewritten again during a parse, so they are
+    // read instead of mapped from then on
+    mutable FileAccess source_access;
+
+    // Statistics of the last load, without the GPU bytes, which are kept up to date below
+    mutable ModelStats stats;
 
     mutable GLuint vao;
     mutable GLuint vertices;
-    mutable GLuint colors;
     mutable size_t vertex_count;
+    mutable size_t vertex_bytes;
+
+    // Total size of the buffers below, while loaded
+    mutable size_t gpu_bytes;
+
+    // Element buffer, only present for indexed meshes
+    mutable GLuint elements;
+    mutable size_t element_bytes;
+    mutable GLenum index_type;
+    mutable size_t index_size;
+    mutable size_t index_count;
+
+    // Arguments of the multi-draw call covering all shapes.
+    // Firsts are used by non-indexed meshes, offsets into the element buffer by indexed ones.
+    mutable std::vector<GLsizei> draw_counts;
+    mutable std::vector<GLint> draw_firsts;
+    mutable std::vector<const void*> draw_offsets;
+
+    // Meshlets of the full mesh, culled against the view before each draw.
+    // The visible ones are drawn with a multi-draw call over merged adjacent meshlets.
+    mutable std::vector<Meshlet> meshlets;
+    mutable std::vector<GLsizei> visible_counts;
+    mutable std::vector<const void*> visible_offsets;
+    mutable size_t culled_meshlets;
+    mutable size_t culled_triangles;
+
+    // Pool the model was prefetched on, which also builds the levels of detail
+    mutable ThreadPool* pool;
+
+    // Levels of detail, drawn from their own element buffer over the same vertices
+    struct LodLevel {
+        GLsizei count;
+        const void* offset;
+    };
+    mutable std::future<LodChain> lod_chain;
+    mutable GLuint lod_elements;
+    // From finest to coarsest
+    mutable std::vector<LodLevel> lod_levels;
+
+    // Built along with the levels of detail, and kept on eviction
+    mutable std::shared_ptr<const Occluder> occluder;
 
-    Impl(std::string_view path);
+    // Triangles of a large model drawn while it is parsed, from a growing vertex buffer
+    mutable std::shared_ptr<Stream> stream;
+    mutable std::chrono::steady_clock::time_point stream_start;
+    mutable GLuint stream_vao;
+    mutable GLuint stream_vertices;
+    mutable size_t stream_capacity;
+    mutable size_t stream_vertex_count;
+
+    Impl(std::string_view path, const ModelOptions& options);
 
     // Delete the OpenGL objects
     ~Impl();
@@ -43,98 +259,671 @@ struct Model::Impl {
     Impl(Impl&&) = delete;
     Impl& operator=(Impl&&) = delete;
 
-    void draw() const;
-    void load() const;
+    // Advances loading, reloading and level of detail builds, before each draw
+    void update() const;
+    void draw(const DrawContext& context) const;
+    void draw_meshlets(const DrawContext& context) const;
+    void draw_instances(const DrawContext& context, const InstanceBuffer& instances) const;
+    void prefetch(ThreadPool& pool, TaskPriority priority) const;
+    bool loading() const;
+    bool busy() const;
+    void debug_print() const;
+    void evict() const;
+    void reload(ThreadPool& pool) const;
+    void start_streaming() const;
+    bool streaming() const;
+
+    // Moves the model into Loaded state, or into Failed state if the parse throws
+    void finish(std::future<LoadedMesh>& data) const;
+    void finish_reload() const;
+    // Builds the levels of detail of the uploaded mesh on the pool, if worthwhile
+    void start_lods(Mesh mesh) const;
+    void upload(const Mesh& data) const;
+    // Swaps in a reloaded mesh.  Returns true if all buffers were reused.
+    bool replace(const Mesh& data) const;
+    // Sets up the draw calls of the uploaded mesh
+    void set_draw_state(const Mesh& data) const;
+    void upload_lods(std::future<LodChain>& chain) const;
     void unload() const;
+
+    // Uploads queued stream batches, within the per-frame limit
+    void drain_stream() const;
+    void append_stream(const std::vector<unsigned char>& batch) const;
+    // Cancels the stream and deletes the stream buffers
+    void stop_streaming() const;
+
+    // Returns the coarsest level of detail dense enough for the screen size, or nullptr if the
+    // full mesh should be drawn
+    const LodLevel* select_level(float screen_size) const;
 };
 
-Model::Impl::Impl(std::string_view path) : path(path), status(LoadStatus::NotYet) {}
+Model::Impl::Impl(std::string_view path, const ModelOptions& options)
+    : path(path), options(options), status(LoadStatus::NotYet), reload_pending(false),
+      source_access(FileAccess::Map), vao(0), vertices(0), vertex_count(0), vertex_bytes(0),
+      gpu_bytes(0), elements(0), element_bytes(0), index_type(GL_NONE), index_size(0),
+      index_count(0), culled_meshlets(0), culled_triangles(0), pool(nullptr), lod_elements(0),
+      stream_vao(0), stream_vertices(0), stream_capacity(0), stream_vertex_count(0) {}
 
-Model::Impl::~Impl() { unload(); }
+Model::Impl::~Impl() {
+    stop_streaming();
+    unload();
+}
 
-Model::Model(std::string_view path) : impl(std::make_shared<Impl>(path)) {}
+Model::Model(std::string_view path, const ModelOptions& options)
+    : impl(std::make_shared<Impl>(path, options)) {}
 
-void Model::draw() const { impl->draw(); }
-void Model::Impl::draw() const {
+void Model::draw(const DrawContext& context) const { impl->draw(context); }
+// The vertex array only names uploaded buffers while loaded
+unsigned int Model::vertex_array() const {
+    return impl->status == LoadStatus::Loaded ? impl->vao : 0;
+}
+std::optional<Bounds> Model::bounds() const { return Bounds{{-1, -1, -1}, {1, 1, 1}}; }
+std::shared_ptr<const Occluder> Model::occluder() const { return impl->occluder; }
+void Model::Impl::update() const {
     if (status == LoadStatus::NotYet) {
+        // Not prefetched, so parse on this thread
+        std::promise<LoadedMesh> promise;
         try {
-            load();
-            status = LoadStatus::Loaded;
-        } catch (const std::exception& e) {
-            std::cerr << "Exception during model load:\n" << e.what() << "\n";
-            status = LoadStatus::Failed;
+            promise.set_value(load_mesh(path, options, source_access, pool));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+        auto data = promise.get_future();
+        finish(data);
+    } else if (status == LoadStatus::Parsing && loading() == false) {
+        finish(parsed);
+    }
+
+    if (status == LoadStatus::Loaded) {
+        if (reloaded.valid() &&
+            reloaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            finish_reload();
+        }
+        if (reload_pending && reloaded.valid() == false && pool != nullptr) {
+            reload_pending = false;
+            reloaded = pool->submit(
+                [path = path, options = options, access = source_access, pool = pool]() {
+                    return load_mesh(path, options, access, pool);
+                });
+        }
+        if (lod_chain.valid() &&
+            lod_chain.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            upload_lods(lod_chain);
+        }
+    }
+}
+
+void Model::Impl::draw(const DrawContext& context) const {
+    update();
+
+    if (status == LoadStatus::Parsing && stream) {
+        drain_stream();
+        if (stream_vertex_count > 0) {
+            bind_vertex_array(stream_vao);
+            glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(stream_vertex_count));
         }
     }
 
     if (status == LoadStatus::Loaded) {
-        glBindVertexArray(vao);
+        bind_vertex_array(vao);
         // NOTE: We don't have boost::numeric_cast available.  This cast may overflow.
-        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertex_count));
+        const auto draw_count = static_cast<GLsizei>(draw_counts.size());
+        if (const LodLevel* level = select_level(context.screen_size)) {
+            bind_buffer(GL_ELEMENT_ARRAY_BUFFER, lod_elements);
+            glDrawElements(GL_TRIANGLES, level->count, index_type, level->offset);
+            bind_buffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+        } else if (meshlets.empty() == false) {
+            draw_meshlets(context);
+        } else if (index_count > 0) {
+            glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), index_type, draw_offsets.data(),
+                                draw_count);
+        } else {
+            glMultiDrawArrays(GL_TRIANGLES, draw_firsts.data(), draw_counts.data(), draw_count);
+        }
+    }
+}
+
+void Model::draw_instances(const DrawContext& context, const InstanceBuffer& instances) const {
+    impl->draw_instances(context, instances);
+}
+void Model::Impl::draw_instances(const DrawContext& context,
+                                 const InstanceBuffer& instances) const {
+    update();
+    if (status != LoadStatus::Loaded || instances.count() == 0) {
+        return;
+    }
+
+    // NOTE: We don't have boost::numeric_cast available.  These casts may overflow.
+    const auto instance_count = static_cast<GLsizei>(instances.count());
+    bind_vertex_array(vao);
+    bind_buffer(GL_ARRAY_BUFFER, instances.buffer());
+    set_instance_attributes();
+
+    // Every copy covers at most the screen size of the model scaled by its matrix.
+    // There is no multi-draw variant of instanced draws in OpenGL 3.3, so ranges are drawn one by
+    // one.
+    if (const LodLevel* level = select_level(context.screen_size * instances.max_scale())) {
+        bind_buffer(GL_ELEMENT_ARRAY_BUFFER, lod_elements);
+        glDrawElementsInstanced(GL_TRIANGLES, level->count, index_type, level->offset,
+                                instance_count);
+        bind_buffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+    } else if (index_count > 0) {
+        for (size_t i = 0; i < draw_counts.size(); i++) {
+            glDrawElementsInstanced(GL_TRIANGLES, draw_counts[i], index_type, draw_offsets[i],
+                                    instance_count);
+        }
+    } else {
+        for (size_t i = 0; i < draw_counts.size(); i++) {
+            glDrawArraysInstanced(GL_TRIANGLES, draw_firsts[i], draw_counts[i], instance_count);
+        }
+    }
+    disable_instance_attributes();
+}
+
+void Model::Impl::draw_meshlets(const DrawContext& context) const {
+    const CullView view = cull_view(context.mvp);
+    visible_counts.clear();
+    visible_offsets.clear();
+    culled_meshlets = 0;
+    culled_triangles = 0;
+
+    std::uint32_t end = 0;
+    for (const auto& meshlet : meshlets) {
+        if (meshlet_visible(meshlet, view, context.cull_backfaces) == false) {
+            culled_meshlets++;
+            culled_triangles += meshlet.count / 3;
+            continue;
+        }
+        if (visible_counts.empty() == false && end == meshlet.first) {
+            visible_counts.back() += static_cast<GLsizei>(meshlet.count);
+        } else {
+            visible_counts.push_back(static_cast<GLsizei>(meshlet.count));
+            visible_offsets.push_back(reinterpret_cast<const void*>(meshlet.first * index_size));
+        }
+        end = meshlet.first + meshlet.count;
+    }
+    glMultiDrawElements(GL_TRIANGLES, visible_counts.data(), index_type, visible_offsets.data(),
+                        static_cast<GLsizei>(visible_counts.size()));
+}
+
+void Model::prefetch(ThreadPool& pool, TaskPriority priority) const {
+    impl->prefetch(pool, priority);
+}
+void Model::Impl::prefetch(ThreadPool& pool, TaskPriority priority) const {
+    if (status == LoadStatus::Parsing && priority == TaskPriority::Urgent && parse_job &&
+        parse_job->claimed == false) {
+        // Still queued, possibly behind prefetches of models that are no longer neighbors
+        pool.submit([job = parse_job]() { job->run(); }, TaskPriority::Urgent);
+        return;
+    }
+    if (status != LoadStatus::NotYet) {
+        return;
+    }
+    parse_job = std::make_shared<ParseJob>();
+    if (options.stream) {
+        parse_job->stream = std::make_shared<Stream>();
+    }
+    parse_job->task = std::packaged_task<LoadedMesh()>(
+        [path = path, options = options, access = source_access, pool = &pool]() {
+            return load_mesh(path, options, access, pool);
+        });
+    parsed = parse_job->task.get_future();
+    pool.submit([job = parse_job]() { job->run(); }, priority);
+    status = LoadStatus::Parsing;
+    this->pool = &pool;
+}
+
+const std::string& Model::path() const { return impl->path; }
+
+void Model::reload(ThreadPool& pool) const { impl->reload(pool); }
+void Model::Impl::reload(ThreadPool& pool) const {
+    this->pool = &pool;
+    source_access = FileAccess::Read;
+    switch (status) {
+    case LoadStatus::NotYet:
+    case LoadStatus::Failed:
+        // Parsed from scratch when next prefetched or drawn
+        status = LoadStatus::NotYet;
+        break;
+    case LoadStatus::Parsing:
+    case LoadStatus::Loaded:
+        // A running parse may have read the old contents, so parse again once it is done
+        reload_pending = true;
+        break;
+    }
+}
+
+bool Model::loading() const { return impl->loading(); }
+bool Model::Impl::loading() const {
+    return status == LoadStatus::Parsing &&
+           parsed.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+bool Model::busy() const { return impl->busy(); }
+bool Model::Impl::busy() const {
+    // A failed parse keeps its pending reload until the file changes again
+    return status == LoadStatus::NotYet || status == LoadStatus::Parsing ||
+           (status == LoadStatus::Loaded && reload_pending) || reloaded.valid() ||
+           lod_chain.valid();
+}
+
+void Model::debug_print() const { impl->debug_print(); }
+void Model::Impl::debug_print() const {
+    std::cout << "Model " << path << ":\n"
+              << "Triangles: " << stats.triangle_count << ", vertices: " << stats.vertex_count
+              << "\n"
+              << "Bytes: file " << stats.file_bytes << ", parsed " << stats.parsed_bytes
+              << ", mesh " << stats.mesh_bytes << ", GPU " << gpu_bytes << "\n"
+              << "Milliseconds: read " << stats.read_ms << ", parse " << stats.parse_ms
+              << ", normalize " << stats.normalize_ms << ", build " << stats.build_ms
+              << ", upload " << stats.upload_ms << (stats.from_cache ? " (mesh cache)" : "")
+              << "\n";
+    if (meshlets.empty()) {
+        std::cout << "No meshlets\n";
+        return;
+    }
+    std::cout << "Meshlets culled: " << culled_meshlets << " of " << meshlets.size() << "\n"
+              << "Triangles culled: " << culled_triangles << " of " << index_count / 3 << "\n";
+}
+
+void Model::start_streaming() const { impl->start_streaming(); }
+void Model::Impl::start_streaming() const {
+    if (!parse_job || !parse_job->stream || status != LoadStatus::Parsing || stream) {
+        return;
+    }
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if (ec || size < STREAM_MIN_BYTES) {
+        return;
+    }
+
+    stream = parse_job->stream;
+    stream_start = std::chrono::steady_clock::now();
+    glGenVertexArrays(1, &stream_vao);
+    // Ahead of the parse, which it only runs alongside on another worker until the parse finishes
+    pool->submit([stream = stream, path = path]() { stream_batches(*stream, path); },
+                 TaskPriority::Urgent);
+}
+
+bool Model::streaming() const { return impl->streaming(); }
+bool Model::Impl::streaming() const {
+    if (!stream) {
+        return false;
+    }
+    if (stream_vertex_count > 0) {
+        return true;
+    }
+    std::lock_guard lock(stream->mutex);
+    return stream->batches.empty() == false;
+}
+
+void Model::Impl::drain_stream() const {
+    size_t uploaded = 0;
+    while (uploaded < STREAM_UPLOAD_PER_FRAME) {
+        std::vector<unsigned char> batch;
+        {
+            std::lock_guard lock(stream->mutex);
+            if (stream->batches.empty()) {
+                break;
+            }
+            batch = std::move(stream->batches.front());
+            stream->batches.pop_front();
+        }
+        stream->space.notify_one();
+
+        if (stream_vertex_count == 0) {
+            const std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - stream_start;
+            std::cerr << "Streamed first triangles of " << path << " in " << elapsed.count()
+                      << " ms\n";
+        }
+        append_stream(batch);
+        uploaded += batch.size();
+    }
+}
+
+void Model::Impl::append_stream(const std::vector<unsigned char>& batch) const {
+    const size_t used = stream_vertex_count * vertex_size(STREAM_FORMAT);
+    if (used + batch.size() > stream_capacity) {
+        // Grow geometrically, copying the uploaded vertices on the GPU
+        const size_t capacity = std::max(2 * stream_capacity, used + batch.size());
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        bind_buffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+        if (stream_capacity > 0) {
+            bind_buffer(GL_COPY_READ_BUFFER, stream_vertices);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            delete_buffer(stream_vertices);
+        }
+        stream_vertices = grown;
+        stream_capacity = capacity;
+
+        bind_vertex_array(stream_vao);
+        bind_buffer(GL_ARRAY_BUFFER, stream_vertices);
+        set_vertex_attributes(STREAM_FORMAT);
+    }
+
+    bind_buffer(GL_ARRAY_BUFFER, stream_vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, used, batch.size(), batch.data());
+    stream_vertex_count += batch.size() / vertex_size(STREAM_FORMAT);
+}
+
+void Model::Impl::stop_streaming() const {
+    if (!stream) {
+        return;
+    }
+    // The task holds the stream until it sees the cancellation
+    stream->cancel = true;
+    stream->space.notify_all();
+    stream.reset();
+
+    if (stream_capacity > 0) {
+        delete_buffer(stream_vertices);
+    }
+    delete_vertex_array(stream_vao);
+    stream_capacity = 0;
+    stream_vertex_count = 0;
+}
+
+ModelStats Model::stats() const {
+    ModelStats stats = impl->stats;
+    stats.gpu_bytes = impl->gpu_bytes;
+    return stats;
+}
+
+void Model::print_stats_json(std::ostream& out) const {
+    const ModelStats s = stats();
+    out << "{\"path\": ";
+    print_json_string(out, impl->path);
+    out << ", \"loaded\": " << (impl->status == LoadStatus::Loaded ? "true" : "false")
+        << ", \"from_cache\": " << (s.from_cache ? "true" : "false")
+        << ", \"file_bytes\": " << s.file_bytes << ", \"parsed_bytes\": " << s.parsed_bytes
+        << ", \"mesh_bytes\": " << s.mesh_bytes << ", \"gpu_bytes\": " << s.gpu_bytes
+        << ", \"read_ms\": " << s.read_ms << ", \"parse_ms\": " << s.parse_ms
+        << ", \"normalize_ms\": " << s.normalize_ms << ", \"build_ms\": " << s.build_ms
+        << ", \"upload_ms\": " << s.upload_ms << ", \"triangles\": " << s.triangle_count
+        << ", \"vertices\": " << s.vertex_count << "}";
+}
+
+size_t Model::gpu_bytes() const { return impl->gpu_bytes; }
+
+void Model::evict() const { impl->evict(); }
+void Model::Impl::evict() const {
+    if (status != LoadStatus::Loaded) {
+        return;
+    }
+    const size_t freed = gpu_bytes;
+    unload();
+    // Pending builds are dropped along with the buffers they would update, and the next load
+    // reads the file anew
+    lod_chain = {};
+    reloaded = {};
+    reload_pending = false;
+    status = LoadStatus::NotYet;
+    std::cerr << "Evicted " << path << " from GPU memory (" << (freed >> 20) << " MiB)\n";
+}
+
+void Model::Impl::finish(std::future<LoadedMesh>& data) const {
+    parse_job.reset();
+    // The loaded mesh replaces the streamed triangles, with exact normalization
+    stop_streaming();
+    try {
+        LoadedMesh loaded = data.get();
+        stats = loaded.stats;
+
+        const auto start = std::chrono::steady_clock::now();
+        upload(loaded.mesh);
+        stats.upload_ms = elapsed_ms(start);
+        status = LoadStatus::Loaded;
+        std::cerr << "Loaded model from " << path << " successfully\n";
+
+        start_lods(std::move(loaded.mesh));
+    } catch (const std::exception& e) {
+        std::cerr << "Exception during model load:\n" << e.what() << "\n";
+        status = LoadStatus::Failed;
+    }
+}
+
+void Model::Impl::finish_reload() const {
+    LoadedMesh loaded;
+    try {
+        loaded = reloaded.get();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to reload " << path << ", keeping the previous mesh:\n"
+                  << e.what() << "\n";
+        return;
+    }
+
+    // Levels of detail of the previous mesh are dropped, and rebuilt for the new one
+    lod_chain = {};
+    const auto start = std::chrono::steady_clock::now();
+    const bool reused = replace(loaded.mesh);
+    stats = loaded.stats;
+    stats.upload_ms = elapsed_ms(start);
+    std::cerr << "Reloaded " << path << (reused ? " into the same buffers\n" : "\n");
+
+    start_lods(std::move(loaded.mesh));
+}
+
+void Model::Impl::start_lods(Mesh mesh) const {
+    const bool levels = options.lod && mesh.index_count / 3 >= MIN_LOD_TRIANGLES;
+    const bool occluder = options.occlusion && mesh.index_count > 0;
+    if (pool != nullptr && (levels || occluder)) {
+        lod_chain = pool->submit([mesh = std::move(mesh), path = path, levels, occluder]() {
+            return build_lods(mesh, path, levels, occluder);
+        });
     }
 }
 
 void Model::Impl::unload() const {
     if (status == LoadStatus::Loaded) {
-        glDeleteBuffers(1, &vertices);
-        glDeleteBuffers(1, &colors);
-        glDeleteVertexArrays(1, &vao);
+        delete_buffer(vertices);
+        if (index_count > 0) {
+            delete_buffer(elements);
+        }
+        if (lod_levels.empty() == false) {
+            delete_buffer(lod_elements);
+            lod_levels.clear();
+        }
+        meshlets.clear();
+        gpu_bytes = 0;
+        delete_vertex_array(vao);
     }
+    // Stale names must not reach the sort key of the render queue
+    vao = 0;
+    vertices = 0;
+    elements = 0;
+    lod_elements = 0;
+    vertex_count = 0;
+    index_count = 0;
 }
 
-void Model::Impl::load() const {
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    tinyobj::attrib_t attrib;
-    std::vector<GLfloat> vertices;
-    std::vector<GLfloat> colors;
-
-    std::string err, warn;
+void Model::Impl::upload_lods(std::future<LodChain>& chain) const {
+    LodChain lods;
+    try {
+        lods = chain.get();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to build levels of detail of " << path << ":\n" << e.what() << "\n";
+        return;
+    }
+    if (lods.occluder) {
+        occluder = std::move(lods.occluder);
+    }
+    if (lods.levels.empty()) {
+        return;
+    }
 
-    bool res = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.data());
+    // The element buffer binding is part of the vertex array object, so restore it afterwards
+    bind_vertex_array(vao);
+    glGenBuffers(1, &lod_elements);
+    bind_buffer(GL_ELEMENT_ARRAY_BUFFER, lod_elements);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lods.indices.size(), lods.indices.data(),
+                 GL_STATIC_DRAW);
+    bind_buffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+    gpu_bytes += lods.indices.size();
 
-    if (res == false) {
-        throw std::runtime_error(std::string("Failed to load object file:\n") + err + "\n" + warn);
+    for (const auto& level : lods.levels) {
+        lod_levels.push_back(LodLevel{static_cast<GLsizei>(level.count),
+                                      reinterpret_cast<const void*>(level.first * index_size)});
     }
+}
 
-    normalize(&attrib, vertices, colors, &shapes[0]);
+const Model::Impl::LodLevel* Model::Impl::select_level(float screen_size) const {
+    const float pixels = 3.14159265f / 4 * screen_size * screen_size;
+    const LodLevel* chosen = nullptr;
+    for (const auto& level : lod_levels) {
+        if (static_cast<float>(level.count / 3) < pixels * TRIANGLES_PER_PIXEL) {
+            break;
+        }
+        chosen = &level;
+    }
+    return chosen;
+}
 
+void Model::Impl::upload(const Mesh& data) const {
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    bind_vertex_array(vao);
 
     glGenBuffers(1, &this->vertices);
-    glBindBuffer(GL_ARRAY_BUFFER, (this->vertices));
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), &vertices.at(0),
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    vertex_count = vertices.size() / 3;
+    bind_buffer(GL_ARRAY_BUFFER, this->vertices);
+    vertex_bytes = 0;
+    write_vertex_buffer(data, vertex_bytes);
+    set_vertex_attributes(data.format);
+
+    set_draw_state(data);
+    element_bytes = 0;
+    if (index_count > 0) {
+        glGenBuffers(1, &elements);
+        bind_buffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size(), data.indices.data(),
+                     GL_STATIC_DRAW);
+        element_bytes = data.indices.size();
+    }
+    gpu_bytes = vertex_bytes + element_bytes;
+}
 
-    glGenBuffers(1, &this->colors);
-    glBindBuffer(GL_ARRAY_BUFFER, this->colors);
-    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(GLfloat), &colors.at(0), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+bool Model::Impl::replace(const Mesh& data) const {
+    if ((data.index_size > 0 && data.index_count > 0) != (index_count > 0)) {
+        // The element buffer appears or disappears, so start over
+        unload();
+        upload(data);
+        return false;
+    }
+
+    if (lod_levels.empty() == false) {
+        delete_buffer(lod_elements);
+        lod_levels.clear();
+    }
+    bind_vertex_array(vao);
+    bind_buffer(GL_ARRAY_BUFFER, vertices);
+    bool reused = write_vertex_buffer(data, vertex_bytes);
+    set_draw_state(data);
+    if (index_count > 0) {
+        bind_buffer(GL_ELEMENT_ARRAY_BUFFER, elements);
+        reused = write_buffer(GL_ELEMENT_ARRAY_BUFFER, element_bytes, data.indices) && reused;
+    }
+    gpu_bytes = vertex_bytes + element_bytes;
+    return reused;
+}
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+void Model::Impl::set_draw_state(const Mesh& data) const {
+    vertex_count = data.vertex_count;
+    index_type = data.index_size == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    index_size = data.index_size;
+    meshlets = data.meshlets;
+    index_count = data.index_size > 0 ? data.index_count : 0;
 
-    std::cerr << "Loaded model from " << path << " successfully\n";
+    // Ranges are adjacent unless shapes are skipped, so merge them to keep the multi-draw short
+    draw_counts.clear();
+    draw_firsts.clear();
+    draw_offsets.clear();
+    for (const auto& range : data.ranges) {
+        if (draw_counts.empty() == false &&
+            static_cast<GLuint>(draw_firsts.back() + draw_counts.back()) == range.first) {
+            draw_counts.back() += static_cast<GLsizei>(range.count);
+            continue;
+        }
+        draw_counts.push_back(static_cast<GLsizei>(range.count));
+        draw_firsts.push_back(static_cast<GLint>(range.first));
+    }
+    for (const GLint first : draw_firsts) {
+        draw_offsets.push_back(reinterpret_cast<const void*>(first * data.index_size));
+    }
 }
 
 struct ModelList::Impl {
+    // Declared first, so that it outlives the models and the occlusion buffer, whose streams and
+    // rasterization run on its workers
+    ThreadPool pool;
+
     std::vector<Model> models;
     size_t index;
-    Impl(const std::vector<std::string>& model_paths);
+
+    // Index of the model drawn in the last frame, drawn again while the current one is not ready
+    std::optional<size_t> shown;
+
+    // Options of models added later
+    ModelOptions options;
+
+    // Matrices of the copies the current model is drawn as, if more than one
+    std::unique_ptr<InstanceBuffer> instances;
+    // Depth buffer the nearest copies are drawn into to cull those behind, if enabled
+    std::unique_ptr<OcclusionBuffer> occlusion;
+
+    // Bytes of GPU buffers to keep, or 0 for no limit
+    size_t gpu_budget;
+    // Frame in which each model was last drawn, for least recently used eviction
+    std::vector<std::uint64_t> last_shown;
+    std::uint64_t frame;
+
+    // Whether the current model changed since the last call to take_dirty
+    bool dirty;
+
+    // Manifest to update as models change, if tracked.  Shared with the tasks storing the changes.
+    std::shared_ptr<ManifestUpdates> manifest;
+
+    Impl(const std::vector<std::string>& model_paths, const ModelOptions& options);
+    ~Impl();
 
     Impl(const Impl&) = delete;
     void operator=(const Impl&) = delete;
     Impl(Impl&&) = delete;
     void operator=(Impl&&) = delete;
+
+    // Starts parsing the current model and its neighbors
+    void prefetch();
+    void draw(const DrawContext& context);
+
+    // Evicts the least recently shown models other than the given one until within the budget
+    void enforce_budget(size_t keep);
+
+    // Queues a change of the path for the tracked manifest, stored by the next flush_manifest
+    void update_manifest(const std::string& path, bool removed);
 };
 
-ModelList::ModelList(const std::vector<std::string>& model_paths)
-    : impl(std::make_shared<Impl>(model_paths)) {}
-ModelList::Impl::Impl(const std::vector<std::string>& model_paths) : models(), index(0) {
+ModelList::ModelList(const std::vector<std::string>& model_paths, const ModelOptions& options)
+    : impl(std::make_shared<Impl>(model_paths, options)) {}
+ModelList::Impl::Impl(const std::vector<std::string>& model_paths, const ModelOptions& options)
+    : pool(), models(), index(0), shown(std::nullopt), options(options),
+      gpu_budget(options.gpu_budget), last_shown(model_paths.size(), 0), frame(0), dirty(true),
+      manifest() {
     for (const auto& path : model_paths) {
-        models.push_back(Model(path));
+        models.push_back(Model(path, options));
+    }
+    if (options.instances > 1) {
+        instances = std::make_unique<InstanceBuffer>(grid_instances(options.instances));
+        if (options.occlusion) {
+            occlusion = std::make_unique<OcclusionBuffer>(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, &pool);
+        }
+    }
+    prefetch();
+}
+
+ModelList::Impl::~Impl() {
+    // Queued tasks are dropped with the pool, so changes they would have stored are stored here
+    if (manifest) {
+        store_manifest_changes(*manifest);
     }
 }
 
@@ -146,117 +935,738 @@ const Model& ModelList::current() const {
 }
 
 void ModelList::next_model() {
+    if (impl->models.empty()) {
+        return;
+    }
     impl->index += 1;
     impl->index %= impl->models.size();
+    impl->dirty = true;
+    impl->prefetch();
 }
 
 void ModelList::prev_model() {
+    if (impl->models.empty()) {
+        return;
+    }
     if (impl->index == 0) {
         impl->index = impl->models.size() - 1;
     } else {
         impl->index -= 1;
     }
+    impl->dirty = true;
+    impl->prefetch();
 }
 
-void ModelList::draw() const { current().draw(); }
+void ModelList::debug_print() const {
+    // Report on the model that was actually drawn
+    if (impl->shown.has_value()) {
+        impl->models.at(*impl->shown).debug_print();
+    }
+    if (impl->instances) {
+        std::cout << "Instances drawn: " << impl->instances->count() << " of "
+                  << impl->instances->total_count() << ", "
+                  << impl->instances->occluded_count() << " in view hidden behind others\n";
+    }
+}
 
-namespace {
-void normalize(tinyobj::attrib_t* attrib, std::vector<GLfloat>& vertices,
-               std::vector<GLfloat>& colors, tinyobj::shape_t* shape) {
-    std::vector<float> xs, ys, zs;
-    float min_x = 10000, max_x = -10000, min_y = 10000, max_y = -10000, min_z = 10000,
-          max_z = -10000;
+void ModelList::print_stats_json(std::ostream& out) const {
+    out << "[";
+    for (size_t i = 0; i < impl->models.size(); i++) {
+        out << (i > 0 ? ",\n " : "");
+        impl->models[i].print_stats_json(out);
+    }
+    out << "]\n";
+}
 
-    // find out min and max value of X, Y and Z axis
-    for (int i = 0; i < attrib->vertices.size(); i++) {
-        // maxs = max(maxs, attrib->vertices.at(i));
-        if (i % 3 == 0) {
+void ModelList::reload(const std::string& path) {
+    impl->update_manifest(path, false);
+    for (const auto& model : impl->models) {
+        if (model.path() == path) {
+            model.reload(impl->pool);
+            impl->dirty = true;
+            impl->prefetch();
+            return;
+        }
+    }
+    impl->models.push_back(Model(path, impl->options));
+    // New files are likely still being written as well
+    impl->models.back().reload(impl->pool);
+    impl->last_shown.push_back(0);
+    std::cerr << "Added model " << path << "\n";
+    impl->dirty = true;
+    impl->prefetch();
+}
 
-            xs.push_back(attrib->vertices.at(i));
+void ModelList::remove(const std::string& path) {
+    auto& models = impl->models;
+    bool removed_any = false;
+    for (;;) {
+        const auto it = std::find_if(models.begin(), models.end(), [&](const Model& model) {
+            return model.path() == path || is_within(model.path(), path);
+        });
+        if (it == models.end()) {
+            break;
+        }
+        const auto removed = static_cast<size_t>(it - models.begin());
+        std::cerr << "Removed model " << it->path() << "\n";
+        models.erase(it);
+        impl->last_shown.erase(impl->last_shown.begin() + static_cast<std::ptrdiff_t>(removed));
+        removed_any = true;
 
-            if (attrib->vertices.at(i) < min_x) {
-                min_x = attrib->vertices.at(i);
-            }
+        // Keep pointing at the same model, or at the next one if the current model was removed
+        auto& index = impl->index;
+        if (removed < index) {
+            index--;
+        } else if (index == models.size()) {
+            index = 0;
+        }
+        auto& shown = impl->shown;
+        if (shown == removed) {
+            shown.reset();
+        } else if (shown.has_value() && *shown > removed) {
+            shown = *shown - 1;
+        }
+    }
+    if (removed_any == false) {
+        return;
+    }
+    impl->update_manifest(path, true);
+    impl->dirty = true;
+    impl->prefetch();
+}
 
-            if (attrib->vertices.at(i) > max_x) {
-                max_x = attrib->vertices.at(i);
-            }
-        } else if (i % 3 == 1) {
-            ys.push_back(attrib->vertices.at(i));
+void ModelList::track_manifest(const ManifestLocation& location) {
+    impl->manifest = std::make_shared<ManifestUpdates>();
+    impl->manifest->location = location;
+}
 
-            if (attrib->vertices.at(i) < min_y) {
-                min_y = attrib->vertices.at(i);
-            }
+void ModelList::Impl::update_manifest(const std::string& path, bool removed) {
+    if (!manifest) {
+        return;
+    }
+    std::lock_guard lock(manifest->mutex);
+    manifest->pending.push_back({path, removed});
+}
 
-            if (attrib->vertices.at(i) > max_y) {
-                max_y = attrib->vertices.at(i);
+void ModelList::flush_manifest() {
+    const auto& manifest = impl->manifest;
+    if (!manifest) {
+        return;
+    }
+    {
+        std::lock_guard lock(manifest->mutex);
+        if (manifest->pending.empty() || manifest->scheduled) {
+            return;
+        }
+        manifest->scheduled = true;
+    }
+    impl->pool.submit([manifest = manifest]() { store_manifest_changes(*manifest); });
+}
+
+bool ModelList::take_dirty() { return std::exchange(impl->dirty, false); }
+
+bool ModelList::busy() const {
+    const auto& models = impl->models;
+    if (models.empty()) {
+        return false;
+    }
+    const auto shown = impl->shown;
+    return models.at(impl->index).busy() || (shown.has_value() && models.at(*shown).busy());
+}
+
+void ModelList::Impl::prefetch() {
+    const size_t count = models.size();
+    if (count == 0) {
+        return;
+    }
+
+    // The current model goes ahead of everything queued, including prefetches of models that were
+    // neighbors before the index changed, so that it is the first to be picked by the workers
+    models.at(index).prefetch(pool, TaskPriority::Urgent);
+    models.at(index).start_streaming();
+    models.at((index + 1) % count).prefetch(pool);
+    models.at((index + count - 1) % count).prefetch(pool);
+}
+
+void ModelList::draw(const DrawContext& context) const { impl->draw(context); }
+unsigned int ModelList::vertex_array() const {
+    if (impl->models.empty()) {
+        return 0;
+    }
+    return impl->models.at(impl->shown.value_or(impl->index)).vertex_array();
+}
+// The instance grid stays within the box as well
+std::optional<Bounds> ModelList::bounds() const { return Bounds{{-1, -1, -1}, {1, 1, 1}}; }
+void ModelList::Impl::draw(const DrawContext& context) {
+    if (models.empty()) {
+        return;
+    }
+    const auto draw_model = [&](const Model& model) {
+        if (instances && model.loading() == false) {
+            model.draw_instances(context, *instances);
+        } else {
+            model.draw(context);
+        }
+    };
+
+    // Draws nothing until the first model finishes parsing or streams in
+    const Model& model = models.at(index);
+    const bool fallback = model.loading() && model.streaming() == false && shown.has_value();
+    const size_t drawn = fallback ? *shown : index;
+    if (instances) {
+        // Until the occluder is built, copies are only culled against the view volume
+        const auto occluder = occlusion ? models.at(drawn).occluder() : nullptr;
+        instances->cull(context.mvp, occluder.get(), occlusion.get());
+    }
+    draw_model(models.at(drawn));
+    if (fallback == false && model.loading() == false) {
+        shown = index;
+    }
+
+    last_shown.at(drawn) = ++frame;
+    enforce_budget(drawn);
+}
+
+void ModelList::Impl::enforce_budget(size_t keep) {
+    if (gpu_budget == 0) {
+        return;
+    }
+    size_t total = 0;
+    for (const auto& model : models) {
+        total += model.gpu_bytes();
+    }
+
+    while (total > gpu_budget) {
+        std::optional<size_t> victim;
+        for (size_t i = 0; i < models.size(); i++) {
+            if (i != keep && models[i].gpu_bytes() > 0 &&
+                (victim.has_value() == false || last_shown[i] < last_shown[*victim])) {
+                victim = i;
             }
-        } else if (i % 3 == 2) {
-            zs.push_back(attrib->vertices.at(i));
+        }
+        if (victim.has_value() == false) {
+            // The drawn model alone exceeds the budget
+            return;
+        }
+        total -= models[*victim].gpu_bytes();
+        models[*victim].evict();
+    }
+}
+
+namespace {
+// Fingerprint of the options that change the built mesh
+std::uint64_t mesh_variant(const ModelOptions& options) {
+    return static_cast<std::uint64_t>(options.vertex_format) |
+           static_cast<std::uint64_t>(options.indexed) << 8 |
+           static_cast<std::uint64_t>(options.optimize) << 9 |
+           static_cast<std::uint64_t>(options.meshlets) << 10;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+bool write_buffer(GLenum target, size_t& size, const Bytes& bytes) {
+    if (bytes.size() == size) {
+        glBufferSubData(target, 0, static_cast<GLsizeiptr>(size), bytes.data());
+        return true;
+    }
+    glBufferData(target, static_cast<GLsizeiptr>(bytes.size()), bytes.data(), GL_STATIC_DRAW);
+    size = bytes.size();
+    return false;
+}
+
+// Packs the vertices of the mesh into the storage of the buffer bound to GL_ARRAY_BUFFER.
+// Without ARB_buffer_storage in OpenGL 3.3 the buffer cannot stay mapped, so it is mapped for
+// this upload only.
+void pack_into_buffer(const Mesh& data, size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(bytes),
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != nullptr) {
+        auto* dst = static_cast<unsigned char*>(mapped);
+        const size_t stride = vertex_size(data.format);
+        const size_t count = data.vertex_count;
+        const size_t hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        const size_t threads =
+            std::clamp<size_t>(count / MIN_PACK_VERTICES_PER_THREAD, 1, hardware);
+        parallel_for(threads, [&](size_t t) {
+            const size_t begin = count * t / threads;
+            const size_t end = count * (t + 1) / threads;
+            data.pack_vertices(begin, end - begin, dst + begin * stride);
+        });
+        // Fails if the contents were lost while mapped, e.g. on a display mode change
+        if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE) {
+            return;
+        }
+    }
+
+    // Fall back to small staging copies
+    std::vector<unsigned char> chunk;
+    for (size_t first = 0; first < data.vertex_count; first += PACK_CHUNK_VERTICES) {
+        const size_t count = std::min(PACK_CHUNK_VERTICES, data.vertex_count - first);
+        chunk.resize(count * vertex_size(data.format));
+        data.pack_vertices(first, count, chunk.data());
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        static_cast<GLintptr>(first * vertex_size(data.format)),
+                        static_cast<GLsizeiptr>(chunk.size()), chunk.data());
+    }
+}
+
+bool write_vertex_buffer(const Mesh& data, size_t& size) {
+    if (!data.pack_vertices) {
+        return write_buffer(GL_ARRAY_BUFFER, size, data.vertices);
+    }
+    const size_t bytes = data.vertex_count * vertex_size(data.format);
+    const bool reused = bytes == size;
+    if (reused == false) {
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STATIC_DRAW);
+        size = bytes;
+    }
+    pack_into_buffer(data, bytes);
+    return reused;
+}
+
+void print_json_string(std::ostream& out, const std::string& value) {
+    const char* hex = "0123456789abcdef";
+    out << '"';
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Fills the statistics that only depend on the built mesh
+void count_mesh(const Mesh& mesh, ModelStats& stats) {
+    stats.mesh_bytes = mesh.vertex_count * vertex_size(mesh.format) + mesh.indices.size();
+    stats.vertex_count = mesh.vertex_count;
+    stats.triangle_count = (mesh.index_size > 0 ? mesh.index_count : mesh.vertex_count) / 3;
+}
+
+// Stores the built mesh in the cache, unless the file changed while it was parsed
+void store_mesh(const MeshCache& cache, const SourceKey& key, const std::string& path,
+                FileAccess access, const Mesh& mesh) {
+    try {
+        // A file that changed during the parse would store the old mesh under the new hash
+        const std::uint64_t hash = source_hash(path, access);
+        const SourceKey after = source_key(path, key.variant);
+        if (after.size == key.size && after.mtime == key.mtime) {
+            cache.store(key, hash, mesh);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to store mesh cache:\n" << e.what() << "\n";
+    }
+}
+
+// Loads the mesh from the cache if possible, otherwise builds it and stores it in the cache.
+// The mesh is stored by a task on the pool if given, so that its upload does not wait for the
+// write.
+LoadedMesh load_mesh(const std::string& path, const ModelOptions& options, FileAccess access,
+                     ThreadPool* pool) {
+    LoadedMesh loaded;
+    std::error_code ec;
+    loaded.stats.file_bytes = static_cast<size_t>(fs::file_size(path, ec));
+    if (ec) {
+        loaded.stats.file_bytes = 0;
+    }
 
-            if (attrib->vertices.at(i) < min_z) {
-                min_z = attrib->vertices.at(i);
+    std::optional<MeshCache> cache;
+    std::optional<SourceKey> key;
+    if (options.cache) {
+        try {
+            const auto start = std::chrono::steady_clock::now();
+            cache.emplace(options.cache_dir.empty() ? MeshCache::default_dir()
+                                                    : fs::path(options.cache_dir));
+            key = source_key(path, mesh_variant(options));
+            auto mesh = cache->load(*key, access);
+            loaded.stats.read_ms = elapsed_ms(start);
+            if (mesh) {
+                std::cerr << "Loaded " << path << " from mesh cache in " << loaded.stats.read_ms
+                          << " ms\n";
+                loaded.mesh = std::move(*mesh);
+                loaded.stats.from_cache = true;
+                count_mesh(loaded.mesh, loaded.stats);
+                return loaded;
             }
+        } catch (const std::exception& e) {
+            std::cerr << "Mesh cache unavailable:\n" << e.what() << "\n";
+            cache.reset();
+        }
+    }
+
+    loaded.mesh = build_mesh(path, options, access, loaded.stats);
+    count_mesh(loaded.mesh, loaded.stats);
+    if (cache.has_value() && key.has_value()) {
+        // The copy of the mesh shares its buffers
+        auto store = [cache = std::move(*cache), key = std::move(*key), path, access,
+                      mesh = loaded.mesh]() { store_mesh(cache, key, path, access, mesh); };
+        if (pool != nullptr) {
+            pool->submit(std::move(store));
+        } else {
+            store();
+        }
+    }
+    return loaded;
+}
+
+Mesh build_mesh(const std::string& path, const ModelOptions& options, FileAccess access,
+                ModelStats& stats) {
+    const auto start = std::chrono::steady_clock::now();
+
+    ObjData obj;
+    const char* parser_name = "";
+    switch (options.parser) {
+    case ModelOptions::Parser::Fast:
+        obj = read_obj(path, access);
+        parser_name = "fast";
+        break;
+    case ModelOptions::Parser::Tinyobj:
+        obj = read_tinyobj(path);
+        parser_name = "tinyobj";
+        break;
+    }
+
+    stats.parse_ms = elapsed_ms(start);
+    stats.parsed_bytes = (obj.positions.size() + obj.colors.size()) * sizeof(float) +
+                         obj.indices.size() * sizeof(std::uint32_t);
+    std::cerr << "Parsed " << path << " in " << stats.parse_ms << " ms with " << parser_name
+              << " parser\n";
+
+    Mesh data;
+    data.format = options.vertex_format;
+    // Expansion and deduplication keep the order of the corners, so ranges carry over as-is
+    for (const auto& shape : obj.shapes) {
+        data.ranges.push_back(DrawRange{static_cast<std::uint32_t>(shape.first_index),
+                                        static_cast<std::uint32_t>(shape.index_count)});
+    }
+    stats.normalize_ms = normalize(&obj);
 
-            if (attrib->vertices.at(i) > max_z) {
-                max_z = attrib->vertices.at(i);
+    const auto build_start = std::chrono::steady_clock::now();
+    if (options.indexed) {
+        if (options.optimize) {
+            optimize(&obj, data.ranges);
+        }
+        if (options.meshlets) {
+            data.meshlets = split_meshlets(&obj, data.ranges);
+        }
+        deduplicate(std::move(obj), data);
+    } else {
+        expand(std::move(obj), data);
+    }
+    stats.build_ms = elapsed_ms(build_start);
+    return data;
+}
+
+ObjData read_tinyobj(const std::string& path) {
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    tinyobj::attrib_t attrib;
+
+    std::string err, warn;
+
+    bool res = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.data());
+
+    if (res == false) {
+        throw std::runtime_error(std::string("Failed to load object file:\n") + err + "\n" + warn);
+    }
+    if (shapes.empty()) {
+        throw std::runtime_error("No shape found in " + path);
+    }
+
+    ObjData obj;
+    obj.positions = std::move(attrib.vertices);
+    obj.colors = std::move(attrib.colors);
+    // Vertices without colors are white, as with the in-tree parser
+    obj.colors.resize(obj.positions.size(), 1.0f);
+
+    // tinyobj passes indices of malformed files through unchecked, and they index the attributes
+    // directly later on
+    const size_t vertex_count = obj.positions.size() / 3;
+    // Faces are already triangulated by tinyobj
+    for (const auto& shape : shapes) {
+        const size_t first = obj.indices.size();
+        for (const auto& idx : shape.mesh.indices) {
+            if (idx.vertex_index < 0 || static_cast<size_t>(idx.vertex_index) >= vertex_count) {
+                throw std::runtime_error("Face index out of range in " + path);
             }
+            obj.indices.push_back(static_cast<std::uint32_t>(idx.vertex_index));
+        }
+        if (obj.indices.size() > first) {
+            obj.shapes.push_back(ObjShape{first, obj.indices.size() - first});
         }
     }
+    return obj;
+}
 
-    float offset_x = (max_x + min_x) / 2;
-    float offset_y = (max_y + min_y) / 2;
-    float offset_z = (max_z + min_z) / 2;
+// Returns the milliseconds taken
+double normalize(ObjData* obj) {
+    const size_t count = obj->positions.size() / 3;
+    const NormalizeStats stats = normalize_points(obj->positions.data(), count);
+    std::cerr << "Normalized " << count << " vertices in " << stats.seconds * 1000 << " ms ("
+              << stats.bytes_per_second / 1e9 << " GB/s, " << stats.kernel << ")\n";
+    return stats.seconds * 1000;
+}
+
+// Reorders the triangles of each shape for the vertex cache and overdraw.
+// The vertices are reordered for fetch locality afterwards by deduplicate, which numbers them in
+// order of first use.
+void optimize(ObjData* obj, const std::vector<DrawRange>& ranges) {
+    const auto start = std::chrono::steady_clock::now();
+    const OptimizeStats stats =
+        optimize_triangles(obj->indices.data(), obj->indices.size(), ranges, obj->positions.data(),
+                           obj->positions.size() / 3);
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Optimized " << obj->indices.size() / 3 << " triangles in " << elapsed.count()
+              << " ms (ACMR " << stats.acmr_before << " -> " << stats.acmr_after << ")\n";
+}
+
+// Groups the triangles of each shape into meshlets.  Deduplication keeps the order of the
+// corners, so the meshlets stay valid for the element buffer.
+std::vector<Meshlet> split_meshlets(ObjData* obj, const std::vector<DrawRange>& ranges) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Meshlet> meshlets =
+        build_meshlets(obj->indices.data(), obj->indices.size(), ranges, obj->positions.data(),
+                       obj->positions.size() / 3);
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Built " << meshlets.size() << " meshlets in " << elapsed.count() << " ms\n";
+    return meshlets;
+}
+
+// Attributes that the vertices of a mesh are packed from on demand
+struct VertexSource {
+    std::vector<float> positions;
+    std::vector<float> colors;
+    // Index into the attributes of each packed vertex
+    std::vector<std::uint32_t> order;
+};
+
+// Makes the vertices of the mesh packed on demand from the source, instead of into a staging
+// buffer that would be copied again by the upload
+void pack_later(std::shared_ptr<const VertexSource> source, Mesh& data) {
+    data.vertex_count = source->order.size();
+    data.pack_vertices = [source = std::move(source), format = data.format](
+                             size_t first, size_t count, unsigned char* dst) {
+        const size_t stride = vertex_size(format);
+        for (size_t i = 0; i < count; i++) {
+            const std::uint32_t idx = source->order[first + i];
+            pack_vertex(format, dst + i * stride, &source->positions[3 * idx],
+                        &source->colors[3 * idx]);
+        }
+    };
+}
+
+// Expands every face corner into its own vertex, to be drawn without indices
+void expand(ObjData&& obj, Mesh& data) {
+    auto source = std::make_shared<VertexSource>();
+    source->positions = std::move(obj.positions);
+    source->colors = std::move(obj.colors);
+    source->order = std::move(obj.indices);
+    pack_later(std::move(source), data);
+}
+
+// Appends the indices to the buffer, narrowed to Index
+template <class Index>
+void append_indices(const std::vector<std::uint32_t>& src, std::vector<unsigned char>& dst) {
+    const size_t start = dst.size();
+    dst.resize(start + src.size() * sizeof(Index));
+    Index* out = reinterpret_cast<Index*>(dst.data() + start);
+    for (size_t i = 0; i < src.size(); i++) {
+        out[i] = static_cast<Index>(src[i]);
+    }
+}
+
+template <class Index> void store_indices(const std::vector<std::uint32_t>& src, Mesh& data) {
+    std::vector<unsigned char> indices;
+    append_indices<Index>(src, indices);
+    data.index_size = sizeof(Index);
+    data.index_count = src.size();
+    data.indices = Bytes(std::move(indices));
+}
 
-    for (int i = 0; i < attrib->vertices.size(); i++) {
-        if (offset_x != 0 && i % 3 == 0) {
-            attrib->vertices.at(i) = attrib->vertices.at(i) - offset_x;
-        } else if (offset_y != 0 && i % 3 == 1) {
-            attrib->vertices.at(i) = attrib->vertices.at(i) - offset_y;
-        } else if (offset_z != 0 && i % 3 == 2) {
-            attrib->vertices.at(i) = attrib->vertices.at(i) - offset_z;
+// Keeps one vertex per distinct (vertex index, color) pair referenced by the faces, in the order of
+// first use, and builds the element buffer referring to them.
+void deduplicate(ObjData&& obj, Mesh& data) {
+    // Colors are attached to the position statements in OBJ files, so the vertex index alone
+    // identifies the pair and a flat remap table is enough.
+    const std::uint32_t unseen = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> remap(obj.positions.size() / 3, unseen);
+    std::vector<std::uint32_t> indices;
+    indices.reserve(obj.indices.size());
+
+    std::uint32_t unique_count = 0;
+    for (const std::uint32_t idx : obj.indices) {
+        if (remap[idx] == unseen) {
+            remap[idx] = unique_count++;
         }
+        indices.push_back(remap[idx]);
+    }
+
+    auto source = std::make_shared<VertexSource>();
+    source->order.resize(unique_count);
+    for (size_t idx = 0; idx < remap.size(); idx++) {
+        if (remap[idx] != unseen) {
+            source->order[remap[idx]] = static_cast<std::uint32_t>(idx);
+        }
+    }
+    source->positions = std::move(obj.positions);
+    source->colors = std::move(obj.colors);
+    obj.indices = {};
+    pack_later(std::move(source), data);
+
+    if (unique_count <= std::numeric_limits<GLushort>::max()) {
+        store_indices<GLushort>(indices, data);
+    } else {
+        store_indices<GLuint>(indices, data);
+    }
+}
+
+// Reads the triangles of the file in batches for a stream, normalized with a sampled bounding box
+// or, failing that, with the bounding box of the first batch.
+void stream_batches(Stream& stream, const std::string& path) {
+    if (stream.cancel) {
+        return;
     }
+    try {
+        Bounds bounds = sample_obj_bounds(path, STREAM_BOUNDS_SAMPLES);
+        bool sampled = bounds.min[0] <= bounds.max[0];
+        const size_t stride = vertex_size(STREAM_FORMAT);
 
-    float greatest_axis = max_x - min_x;
-    float dist_y_axis = max_y - min_y;
-    float dist_z_axis = max_z - min_z;
+        stream_obj(
+            path, STREAM_BATCH_TRIANGLES,
+            [&](ObjBatch& batch) {
+                const size_t count = batch.positions.size() / 3;
+                if (sampled == false) {
+                    bounds = compute_bounds(batch.positions.data(), count);
+                    sampled = true;
+                }
+                center_and_scale(batch.positions.data(), count, bounds);
+                std::vector<unsigned char> vertices(count * stride);
+                for (size_t i = 0; i < count; i++) {
+                    pack_vertex(STREAM_FORMAT, &vertices[i * stride], &batch.positions[3 * i],
+                                &batch.colors[3 * i]);
+                }
 
-    if (dist_y_axis > greatest_axis) {
-        greatest_axis = dist_y_axis;
+                std::unique_lock lock(stream.mutex);
+                stream.space.wait(lock, [&]() {
+                    return stream.cancel || stream.batches.size() < STREAM_MAX_QUEUED_BATCHES;
+                });
+                if (stream.cancel) {
+                    return false;
+                }
+                stream.batches.push_back(std::move(vertices));
+                return true;
+            },
+            stream.cancel);
+    } catch (const std::exception& e) {
+        std::cerr << "Stopped streaming " << path << ":\n" << e.what() << "\n";
     }
+}
 
-    if (dist_z_axis > greatest_axis) {
-        greatest_axis = dist_z_axis;
+void store_manifest_changes(ManifestUpdates& updates) {
+    std::lock_guard writing(updates.writing);
+    for (;;) {
+        std::vector<ManifestChange> changes;
+        {
+            std::lock_guard lock(updates.mutex);
+            changes.swap(updates.pending);
+            if (changes.empty()) {
+                updates.scheduled = false;
+                return;
+            }
+        }
+        try {
+            update_manifest(updates.location, changes);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to update manifest:\n" << e.what() << "\n";
+        }
     }
+}
 
-    float scale = greatest_axis / 2;
+// Simplifies the mesh into LOD_RATIOS of its triangles if levels is set, and the coarsest level
+// further into an occluder if occluder is set.  Positions are read back from the vertex buffer, and
+// the levels use the index size of the mesh.
+LodChain build_lods(const Mesh& mesh, const std::string& path, bool levels, bool occluder) {
+    const auto start = std::chrono::steady_clock::now();
 
-    for (int i = 0; i < attrib->vertices.size(); i++) {
-        // std::cout << i << " = " << (double)(attrib.vertices.at(i) /
-        // greatestAxis)
-        // << "\n";
-        attrib->vertices.at(i) = attrib->vertices.at(i) / scale;
+    const size_t stride = vertex_size(mesh.format);
+    std::vector<float> positions(3 * mesh.vertex_count);
+    std::vector<unsigned char> chunk;
+    for (size_t first = 0; first < mesh.vertex_count; first += PACK_CHUNK_VERTICES) {
+        const size_t count = std::min(PACK_CHUNK_VERTICES, mesh.vertex_count - first);
+        chunk.resize(count * stride);
+        read_vertices(mesh, first, count, chunk.data());
+        for (size_t v = 0; v < count; v++) {
+            unpack_position(mesh.format, &chunk[v * stride], &positions[3 * (first + v)]);
+        }
+    }
+    std::vector<std::uint32_t> indices(mesh.index_count);
+    for (size_t i = 0; i < mesh.index_count; i++) {
+        if (mesh.index_size == sizeof(GLushort)) {
+            GLushort index;
+            std::memcpy(&index, mesh.indices.data() + i * sizeof(index), sizeof(index));
+            indices[i] = index;
+        } else {
+            GLuint index;
+            std::memcpy(&index, mesh.indices.data() + i * sizeof(index), sizeof(index));
+            indices[i] = index;
+        }
     }
-    size_t index_offset = 0;
-    vertices.reserve(shape->mesh.num_face_vertices.size() * 3);
-    colors.reserve(shape->mesh.num_face_vertices.size() * 3);
-    for (size_t f = 0; f < shape->mesh.num_face_vertices.size(); f++) {
-        int fv = shape->mesh.num_face_vertices[f];
 
-        // Loop over vertices in the face.
-        for (size_t v = 0; v < fv; v++) {
-            // access to vertex
-            tinyobj::index_t idx = shape->mesh.indices[index_offset + v];
-            vertices.push_back(attrib->vertices[3 * idx.vertex_index + 0]);
-            vertices.push_back(attrib->vertices[3 * idx.vertex_index + 1]);
-            vertices.push_back(attrib->vertices[3 * idx.vertex_index + 2]);
-            // Optional: vertex colors
-            colors.push_back(attrib->colors[3 * idx.vertex_index + 0]);
-            colors.push_back(attrib->colors[3 * idx.vertex_index + 1]);
-            colors.push_back(attrib->colors[3 * idx.vertex_index + 2]);
+    LodChain chain;
+    const auto chain_levels =
+        levels ? simplify_chain(indices.data(), indices.size(), positions.data(),
+                                mesh.vertex_count, LOD_RATIOS)
+               : std::vector<std::vector<std::uint32_t>>{};
+    for (const auto& level : chain_levels) {
+        const size_t first = chain.indices.size() / mesh.index_size;
+        chain.levels.push_back(DrawRange{static_cast<std::uint32_t>(first),
+                                         static_cast<std::uint32_t>(level.size())});
+        if (mesh.index_size == sizeof(GLushort)) {
+            append_indices<GLushort>(level, chain.indices);
+        } else {
+            append_indices<GLuint>(level, chain.indices);
         }
-        index_offset += fv;
     }
+
+    if (occluder) {
+        // Simplifying the coarsest level is much cheaper than the full mesh
+        std::vector<std::uint32_t> source = chain_levels.empty() ? indices : chain_levels.back();
+        if (source.size() / 3 > OCCLUDER_TRIANGLES) {
+            const float ratio = static_cast<float>(OCCLUDER_TRIANGLES) /
+                                static_cast<float>(source.size() / 3);
+            auto coarser = simplify_chain(source.data(), source.size(), positions.data(),
+                                          mesh.vertex_count, {ratio});
+            if (coarser.empty() == false) {
+                source = std::move(coarser.back());
+            }
+        }
+        chain.occluder = std::make_shared<const Occluder>(make_occluder(source, positions.data()));
+    }
+
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Built " << chain_levels.size() << " levels of detail for " << path << " in "
+              << elapsed.count() << " ms (";
+    for (size_t i = 0; i < chain_levels.size(); i++) {
+        std::cerr << (i > 0 ? ", " : "") << chain_levels[i].size() / 3;
+    }
+    std::cerr << " triangles";
+    if (chain.occluder) {
+        std::cerr << ", occluder " << chain.occluder->indices.size() / 3;
+    }
+    std::cerr << ")\n";
+    return chain;
 }
 } // namespace
@@ -3,26 +3,169 @@
 
 #include <cstddef>
 #include <memory>
+#include <ostream>
+#include <string>
 #include <string_view>
 #include <vector>
 
 #include "drawable.hpp"
+#include "manifest.hpp"
+#include "threadpool.hpp"
+#include "vertex.hpp"
 
 using std::size_t;
 
+class InstanceBuffer;
+class OcclusionBuffer;
+struct Occluder;
 class Window;
 
+// Options of the model loading pipeline.
+struct ModelOptions {
+    enum class Parser {
+        // Memory-mapped, multi-threaded in-tree parser
+        Fast,
+        // tinyobjloader, kept for comparison
+        Tinyobj,
+    };
+    Parser parser = Parser::Fast;
+
+    // Draw with an element buffer over deduplicated vertices, instead of one vertex per corner
+    bool indexed = true;
+
+    // Reorder the triangles of indexed meshes for the post-transform vertex cache and overdraw
+    bool optimize = false;
+
+    // Split indexed meshes into meshlets, which are culled against the view every frame
+    bool meshlets = false;
+
+    // Build coarser levels of detail of indexed meshes in the background after load
+    bool lod = true;
+
+    // Build coarse occluders of indexed meshes in the background after load, and cull the copies
+    // ModelList draws against a software depth buffer of the nearest ones
+    bool occlusion = false;
+
+    // Draw the triangles of large files as they are parsed, until the full load finishes
+    bool stream = false;
+
+    // Packing of the vertex buffer
+    VertexFormat vertex_format = VertexFormat::Compact;
+
+    // Reuse preprocessed meshes stored in cache_dir, or in the default cache directory if empty
+    bool cache = true;
+    std::string cache_dir;
+
+    // Copies of the current model ModelList draws on a grid, with instancing if more than one
+    size_t instances = 1;
+
+    // Bytes of GPU buffers ModelList keeps for its models, evicting the least recently shown ones
+    // beyond it.  Unlimited if 0.
+    size_t gpu_budget = size_t{1} << 30;
+};
+
+// Costs of loading and keeping a model, for profiling.
+struct ModelStats {
+    // Bytes at each stage: the model file, the positions, colors and indices as parsed, the vertex
+    // and element buffers built from them, and the GPU buffers currently held
+    size_t file_bytes = 0;
+    size_t parsed_bytes = 0;
+    size_t mesh_bytes = 0;
+    size_t gpu_bytes = 0;
+
+    // Wall-clock milliseconds of each stage.  Reading covers hashing the file and loading the mesh
+    // cache, and building covers optimization, meshlets and packing the buffers.
+    double read_ms = 0;
+    double parse_ms = 0;
+    double normalize_ms = 0;
+    double build_ms = 0;
+    double upload_ms = 0;
+
+    // Whether the mesh was loaded from the mesh cache, skipping parsing and building
+    bool from_cache = false;
+
+    size_t triangle_count = 0;
+    size_t vertex_count = 0;
+};
+
 // Wrapper class for OpenGL data buffers.
 // Provides API to draw the buffers.
 //
+// The model file is parsed on first draw, unless it has already been prefetched on a thread pool.
+//
 // Note that copies refers to the same data buffers.
 // The data buffers are deleted when all copies are destructed.
 class Model final : public Drawable {
   public:
-    Model(std::string_view path);
+    Model(std::string_view path, const ModelOptions& options = {});
+
+    // Draws the model using GL functions.
+    // If the model is being parsed in the background, nothing but streamed triangles is drawn until
+    // the parse finishes.
+    // Once levels of detail are built, the coarsest one that is still dense enough for the
+    // screen size of the model is drawn.
+    virtual void draw(const DrawContext& context) const override;
+
+    // Returns the vertex array of the full mesh, or 0 until it is uploaded.
+    virtual unsigned int vertex_array() const override;
+
+    // Returns the box models are normalized into.
+    virtual std::optional<Bounds> bounds() const override;
+
+    // Returns a coarse copy of the mesh for occlusion culling, or nothing until it is built.
+    // Only built if enabled in the options.
+    std::shared_ptr<const Occluder> occluder() const;
 
-    // Draws the model using GL functions
-    virtual void draw() const override;
+    // Draws a copy of the model for each matrix of the instances with instanced draw calls.
+    // The level of detail is picked for the largest copy, and meshlets are not culled.
+    // Loads the model like draw, but draws nothing before it is loaded.
+    void draw_instances(const DrawContext& context, const InstanceBuffer& instances) const;
+
+    // Starts parsing the model file on the pool, if it has not been started yet.
+    // Only the GL upload is left to be done by the first draw after the parse finishes.
+    // The levels of detail are built on the same pool afterwards.
+    // An urgent prefetch of a model whose parse is still queued moves the parse ahead of the other
+    // queued tasks.
+    void prefetch(ThreadPool& pool, TaskPriority priority = TaskPriority::Normal) const;
+
+    // Returns true while the model is being parsed in the background.
+    bool loading() const;
+
+    // Returns the path of the model file.
+    const std::string& path() const;
+
+    // Parses the model file again on the pool after it changed.
+    // A loaded model keeps being drawn until the next draw after the parse finishes, which swaps in
+    // the new mesh, reusing the GPU buffers whose size is unchanged.
+    void reload(ThreadPool& pool) const;
+
+    // Starts reading the triangles of a large model in the background, if enabled in the options
+    // and the model is being parsed.  Until the parse finishes, draw shows the triangles read so
+    // far, normalized with a sampled bounding box.
+    void start_streaming() const;
+
+    // Returns true while streamed triangles are ready to be drawn in place of the loading model.
+    bool streaming() const;
+
+    // Returns true while background work will change what draw shows: a parse, a stream, a
+    // reload or a build of levels of detail.
+    bool busy() const;
+
+    // Prints load statistics and meshlet culling statistics of the last frame to standard output.
+    void debug_print() const;
+
+    // Returns the load statistics of the model.  All zero until the model is loaded.
+    ModelStats stats() const;
+
+    // Writes the path and load statistics of the model as a JSON object.
+    void print_stats_json(std::ostream& out) const;
+
+    // Returns the size of the GPU buffers currently held by the model.
+    size_t gpu_bytes() const;
+
+    // Frees the GPU buffers.
+    // The model is loaded again, usually from the mesh cache, when it is next prefetched or drawn.
+    void evict() const;
 
   private:
     struct Impl;
@@ -31,10 +174,16 @@ class Model final : public Drawable {
 
 // Container of models that provides ability to cycle through the models.
 //
+// Models are parsed on a worker pool.  The current model and its previous and next neighbors are
+// prefetched, and until the current model is ready or streams in, the last shown model is drawn in
+// its place.
+// Shown models stay on the GPU until their buffers exceed the budget in the options, and are then
+// evicted in least recently shown order.
+//
 // Note that copies refers to the same data.
 class ModelList final : public Drawable {
   public:
-    ModelList(const std::vector<std::string>& model_paths);
+    ModelList(const std::vector<std::string>& model_paths, const ModelOptions& options = {});
 
     // Returns a reference to the current model.
     const Model& current() const;
@@ -45,7 +194,40 @@ class ModelList final : public Drawable {
     // Switches current index to the previous model.
     void prev_model();
 
-    virtual void draw() const override;
+    // Prints debug information of the current model, and how many of its copies were culled in the
+    // last frame, to standard output.
+    void debug_print() const;
+
+    // Writes the load statistics of every model as a JSON array.
+    void print_stats_json(std::ostream& out) const;
+
+    // Keeps the stored manifest of the location up to date as models are reloaded and removed.
+    void track_manifest(const ManifestLocation& location);
+
+    // Stores the changes of the models reloaded and removed since the last call in the tracked
+    // manifest, in a single update on the thread pool.
+    void flush_manifest();
+
+    // Reloads the model with the path after its file changed, or appends a new model if there is
+    // none.
+    void reload(const std::string& path);
+
+    // Removes the model with the path, or all models below it if it is a directory, after it was
+    // deleted.
+    void remove(const std::string& path);
+
+    // Returns true if the current model changed since the last call, by switching, reloading or
+    // removing models.
+    bool take_dirty();
+
+    // Returns true while the current or the shown model is busy loading in the background, so
+    // that frames keep being drawn until it finishes.
+    bool busy() const;
+
+    // Draws the current model, or the copies of it in view if there are instances.
+    virtual void draw(const DrawContext& context) const override;
+    virtual unsigned int vertex_array() const override;
+    virtual std::optional<Bounds> bounds() const override;
 
   private:
     struct Impl;
@@ -0,0 +1,556 @@
+#include "objreader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
+
+namespace {
+// Files smaller than this per thread are not worth splitting further
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+// Bytes at the head of a file searched for comments stating the counts
+const size_t SNIFF_HEAD_BYTES = 4096;
+
+// Samples counted, and bytes per sample, when a file states no counts
+const size_t SNIFF_SAMPLES = 16;
+const size_t SNIFF_SAMPLE_BYTES = 4096;
+
+// Exactly representable powers of ten
+const std::array<double, 23> POW10{1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                   1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                   1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Line-aligned part of the file, parsed by one thread.
+struct Chunk {
+    const char* begin;
+    const char* end;
+
+    // Filled by the counting pass
+    size_t vertex_count;
+    size_t index_count;
+
+    // Offsets of this chunk into the output arrays
+    size_t vertex_base;
+    size_t index_base;
+
+    // Filled by the parsing pass: offsets into the indices where `o` or `g` statements occur
+    std::vector<size_t> shape_starts;
+};
+
+class ParseError : public std::runtime_error {
+  public:
+    ParseError(const char* what, const char* at) : std::runtime_error(what), at(at) {}
+    const char* at;
+};
+
+bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+const char* skip_blanks(const char* p, const char* end) {
+    while (p < end && is_blank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+const char* skip_token(const char* p, const char* end) {
+    while (p < end && is_blank(*p) == false) {
+        p++;
+    }
+    return p;
+}
+
+// Returns the end of the line starting at p, excluding the line feed
+const char* line_end(const char* p, const char* end) {
+    const void* lf = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return lf == nullptr ? end : static_cast<const char*>(lf);
+}
+
+// Returns true if the line is a statement with the single-character keyword, e.g. "v" or "f"
+bool is_statement(const char* p, const char* end, char keyword) {
+    return end - p >= 2 && p[0] == keyword && is_blank(p[1]);
+}
+
+// Parses a decimal floating-point number without going through the locale-aware libc parsers.
+// Returns false if there is no number at p.
+bool parse_float(const char*& p, const char* end, float& out) {
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        s++;
+    }
+
+    // Keep up to 19 significant digits, which always fit in 64 bits
+    std::uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    for (; s < end && is_digit(*s); s++) {
+        any_digit = true;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(*s - '0');
+            significant += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && is_digit(*s); s++) {
+            any_digit = true;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + static_cast<std::uint64_t>(*s - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (any_digit == false) {
+        return false;
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        s++;
+        bool negative_exponent = false;
+        if (s < end && (*s == '-' || *s == '+')) {
+            negative_exponent = *s == '-';
+            s++;
+        }
+        if (s == end || is_digit(*s) == false) {
+            return false;
+        }
+        int value = 0;
+        for (; s < end && is_digit(*s); s++) {
+            value = std::min(value * 10 + (*s - '0'), 1000);
+        }
+        exponent += negative_exponent ? -value : value;
+    }
+
+    double value = static_cast<double>(mantissa);
+    while (exponent > 22) {
+        value *= POW10[22];
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        value /= POW10[22];
+        exponent += 22;
+    }
+    value = exponent >= 0 ? value * POW10[exponent] : value / POW10[-exponent];
+
+    out = static_cast<float>(negative ? -value : value);
+    p = s;
+    return true;
+}
+
+// Parses the vertex index of a face corner such as "3", "-1", "3/1" or "3/1/2"
+long parse_index(const char*& p, const char* end) {
+    const char* s = p;
+    bool negative = false;
+    if (s < end && *s == '-') {
+        negative = true;
+        s++;
+    }
+    if (s == end || is_digit(*s) == false) {
+        throw ParseError("Malformed face index", p);
+    }
+    long value = 0;
+    for (; s < end && is_digit(*s); s++) {
+        const int digit = *s - '0';
+        if (value > (std::numeric_limits<long>::max() - digit) / 10) {
+            throw ParseError("Face index out of range", p);
+        }
+        value = value * 10 + digit;
+    }
+    // Texture coordinate and normal indices are not used
+    p = skip_token(s, end);
+    return negative ? -value : value;
+}
+
+// Counts the number of corners of a face statement, given the part after the keyword
+size_t count_corners(const char* p, const char* end) {
+    size_t corners = 0;
+    while ((p = skip_blanks(p, end)) < end) {
+        p = skip_token(p, end);
+        corners++;
+    }
+    return corners;
+}
+
+// Parses a vertex statement into three position and three color floats
+void parse_vertex(const char* p, const char* end, float* position, float* color) {
+    // x y z [w] or x y z r g b
+    std::array<float, 7> values{};
+    size_t n = 0;
+    const char* q = skip_blanks(p + 1, end);
+    while (q < end && n < values.size()) {
+        if (parse_float(q, end, values[n]) == false) {
+            throw ParseError("Malformed number", q);
+        }
+        n++;
+        q = skip_blanks(q, end);
+    }
+    if (n < 3) {
+        throw ParseError("Vertex with less than 3 coordinates", p);
+    }
+    std::copy(values.begin(), values.begin() + 3, position);
+    if (n >= 6) {
+        std::copy(values.begin() + 3, values.begin() + 6, color);
+    } else {
+        std::fill(color, color + 3, 1.0f);
+    }
+}
+
+// Triangulates a face statement as a fan around its first corner, calling emit with the three
+// resolved vertex indices of every triangle
+template <class Resolve, class Emit>
+void parse_face(const char* p, const char* end, Resolve resolve, Emit emit) {
+    const char* q = skip_blanks(p + 1, end);
+    if (count_corners(q, end) < 3) {
+        return;
+    }
+    const std::uint32_t first = resolve(parse_index(q, end), p);
+    q = skip_blanks(q, end);
+    std::uint32_t prev = resolve(parse_index(q, end), p);
+    while ((q = skip_blanks(q, end)) < end) {
+        const std::uint32_t next = resolve(parse_index(q, end), p);
+        emit(first, prev, next);
+        prev = next;
+    }
+}
+
+// First pass: counts vertices and triangulated indices of the chunk
+void count(Chunk& chunk) {
+    chunk.vertex_count = chunk.index_count = 0;
+    for (const char* p = chunk.begin; p < chunk.end;) {
+        const char* end = line_end(p, chunk.end);
+        p = skip_blanks(p, end);
+        if (is_statement(p, end, 'v')) {
+            chunk.vertex_count++;
+        } else if (is_statement(p, end, 'f')) {
+            const size_t corners = count_corners(p + 1, end);
+            if (corners >= 3) {
+                chunk.index_count += (corners - 2) * 3;
+            }
+        }
+        p = end + 1;
+    }
+}
+
+// Second pass: parses the chunk into its slices of the output arrays
+void parse(Chunk& chunk, ObjData& data, size_t total_vertex_count) {
+    float* positions = data.positions.data() + chunk.vertex_base * 3;
+    float* colors = data.colors.data() + chunk.vertex_base * 3;
+    std::uint32_t* indices = data.indices.data() + chunk.index_base;
+    size_t vertex_count = chunk.vertex_base;
+
+    const auto resolve = [&](long index, const char* at) {
+        // Negative indices are relative to the vertices defined so far
+        const long resolved = index > 0 ? index - 1 : static_cast<long>(vertex_count) + index;
+        if (index == 0 || resolved < 0 || static_cast<size_t>(resolved) >= total_vertex_count) {
+            throw ParseError("Face index out of range", at);
+        }
+        return static_cast<std::uint32_t>(resolved);
+    };
+
+    for (const char* p = chunk.begin; p < chunk.end;) {
+        const char* end = line_end(p, chunk.end);
+        p = skip_blanks(p, end);
+        if (is_statement(p, end, 'v')) {
+            parse_vertex(p, end, positions, colors);
+            positions += 3;
+            colors += 3;
+            vertex_count++;
+        } else if (is_statement(p, end, 'f')) {
+            parse_face(p, end, resolve, [&](std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+                indices[0] = a;
+                indices[1] = b;
+                indices[2] = c;
+                indices += 3;
+            });
+        } else if (is_statement(p, end, 'o') || is_statement(p, end, 'g')) {
+            chunk.shape_starts.push_back(static_cast<size_t>(indices - data.indices.data()));
+        }
+        p = end + 1;
+    }
+}
+} // namespace
+
+ObjData read_obj(const std::string& path, FileAccess access) {
+    const MappedFile file{path, access};
+    const char* data = file.data();
+    const size_t size = file.size();
+
+    // Split into line-aligned chunks
+    const size_t max_chunks = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const size_t chunk_count = std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, max_chunks);
+    std::vector<Chunk> chunks(chunk_count);
+    const char* begin = data;
+    for (size_t i = 0; i < chunk_count; i++) {
+        const char* end = data + size;
+        if (i + 1 < chunk_count) {
+            const char* lf = line_end(std::max(data + size * (i + 1) / chunk_count, begin), end);
+            end = lf == end ? end : lf + 1;
+        }
+        chunks[i] = Chunk{begin, end, 0, 0, 0, 0, {}};
+        begin = end;
+    }
+
+    parallel_for(chunk_count, [&](size_t i) { count(chunks[i]); });
+
+    size_t vertex_count = 0, index_count = 0;
+    for (auto& chunk : chunks) {
+        chunk.vertex_base = vertex_count;
+        chunk.index_base = index_count;
+        vertex_count += chunk.vertex_count;
+        index_count += chunk.index_count;
+    }
+
+    ObjData obj;
+    obj.positions.resize(vertex_count * 3);
+    obj.colors.resize(vertex_count * 3);
+    obj.indices.resize(index_count);
+
+    try {
+        parallel_for(chunk_count, [&](size_t i) { parse(chunks[i], obj, vertex_count); });
+    } catch (const ParseError& e) {
+        throw std::runtime_error(std::string(e.what()) + " at byte " +
+                                 std::to_string(e.at - data) + " of " + path);
+    }
+
+    // Faces before the first `o` or `g` statement form a shape of their own
+    size_t first = 0;
+    for (const auto& chunk : chunks) {
+        for (const size_t start : chunk.shape_starts) {
+            if (start > first) {
+                obj.shapes.push_back(ObjShape{first, start - first});
+            }
+            first = start;
+        }
+    }
+    if (index_count > first) {
+        obj.shapes.push_back(ObjShape{first, index_count - first});
+    }
+
+    return obj;
+}
+
+void stream_obj(const std::string& path, size_t batch_size,
+                const std::function<bool(ObjBatch&)>& emit, const std::atomic<bool>& cancel) {
+    const MappedFile file{path};
+    const char* data = file.data();
+    const char* file_end = data + file.size();
+
+    std::vector<float> positions;
+    std::vector<float> colors;
+    ObjBatch batch;
+    batch.positions.reserve(batch_size * 9);
+    batch.colors.reserve(batch_size * 9);
+
+    const auto resolve = [&](long index, const char* at) {
+        const long vertex_count = static_cast<long>(positions.size() / 3);
+        const long resolved = index > 0 ? index - 1 : vertex_count + index;
+        if (index == 0 || resolved < 0 || resolved >= vertex_count) {
+            throw ParseError("Face index out of range", at);
+        }
+        return static_cast<std::uint32_t>(resolved);
+    };
+    const auto append = [&](std::uint32_t v) {
+        batch.positions.insert(batch.positions.end(), &positions[3 * v], &positions[3 * v + 3]);
+        batch.colors.insert(batch.colors.end(), &colors[3 * v], &colors[3 * v + 3]);
+    };
+
+    try {
+        for (const char* p = data; p < file_end;) {
+            if (cancel.load(std::memory_order_relaxed)) {
+                return;
+            }
+            const char* end = line_end(p, file_end);
+            p = skip_blanks(p, end);
+            if (is_statement(p, end, 'v')) {
+                positions.resize(positions.size() + 3);
+                colors.resize(colors.size() + 3);
+                parse_vertex(p, end, &positions[positions.size() - 3], &colors[colors.size() - 3]);
+            } else if (is_statement(p, end, 'f')) {
+                bool stop = false;
+                parse_face(p, end, resolve, [&](std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+                    append(a);
+                    append(b);
+                    append(c);
+                    if (batch.positions.size() >= batch_size * 9) {
+                        stop = stop || emit(batch) == false;
+                        batch.positions.clear();
+                        batch.colors.clear();
+                    }
+                });
+                if (stop) {
+                    return;
+                }
+            }
+            p = end + 1;
+        }
+    } catch (const ParseError& e) {
+        throw std::runtime_error(std::string(e.what()) + " at byte " +
+                                 std::to_string(e.at - data) + " of " + path);
+    }
+    if (batch.positions.empty() == false) {
+        emit(batch);
+    }
+}
+
+Bounds sample_obj_bounds(const std::string& path, size_t sample_count) {
+    const MappedFile file{path};
+    const char* data = file.data();
+    const char* file_end = data + file.size();
+
+    const float inf = std::numeric_limits<float>::infinity();
+    Bounds bounds{{inf, inf, inf}, {-inf, -inf, -inf}};
+    for (size_t i = 0; i < sample_count && file.size() > 0; i++) {
+        // Start at the line following the offset
+        const char* p = data + file.size() * i / sample_count;
+        if (p != data) {
+            p = line_end(p, file_end) + 1;
+        }
+        if (p >= file_end) {
+            continue;
+        }
+        const char* end = line_end(p, file_end);
+        p = skip_blanks(p, end);
+        if (is_statement(p, end, 'v') == false) {
+            continue;
+        }
+
+        float position[3], color[3];
+        try {
+            parse_vertex(p, end, position, color);
+        } catch (const ParseError&) {
+            continue;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            bounds.min[axis] = std::min(bounds.min[axis], position[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], position[axis]);
+        }
+    }
+    return bounds;
+}
+
+namespace {
+// Reads a count stated next to one of the words in a comment line, like "# Vertices: 8" or
+// "# 8 vertices".  Returns false if there is none.
+bool stated_count(const char* p, const char* end, std::initializer_list<const char*> words,
+                  std::uint64_t& count) {
+    std::vector<std::string> tokens;
+    while (p < end) {
+        while (p < end && (is_blank(*p) || *p == ':' || *p == ',' || *p == '#')) {
+            p++;
+        }
+        const char* start = p;
+        while (p < end && is_blank(*p) == false && *p != ':' && *p != ',') {
+            p++;
+        }
+        if (p > start) {
+            std::string token(start, p);
+            for (auto& c : token) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            tokens.push_back(std::move(token));
+        }
+    }
+
+    const auto parse_count = [&](const std::string& token) {
+        const auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), count);
+        return ec == std::errc() && ptr == token.data() + token.size();
+    };
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const bool matches = std::any_of(words.begin(), words.end(),
+                                         [&](const char* word) { return tokens[i] == word; });
+        if (matches && ((i > 0 && parse_count(tokens[i - 1])) ||
+                        (i + 1 < tokens.size() && parse_count(tokens[i + 1])))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Counts the vertex and face statements of the lines in [p, end), and returns the end of the last
+// line counted.  The last line is only counted if it is complete or if last is set.
+const char* count_statements(const char* p, const char* end, bool last, ObjCounts& counts) {
+    const char* counted = p;
+    while (p < end) {
+        const char* eol = line_end(p, end);
+        if (eol == end && last == false) {
+            break;
+        }
+        const char* s = skip_blanks(p, eol);
+        counts.vertex_count += is_statement(s, eol, 'v');
+        counts.face_count += is_statement(s, eol, 'f');
+        counted = eol;
+        p = eol + 1;
+    }
+    return counted;
+}
+} // namespace
+
+ObjCounts sniff_obj_counts(const std::string& path) {
+    const MappedFile file{path};
+    const char* data = file.data();
+    const size_t size = file.size();
+    const char* file_end = data + size;
+
+    ObjCounts stated{0, 0};
+    bool has_vertices = false;
+    bool has_faces = false;
+    const char* head_end = data + std::min(size, SNIFF_HEAD_BYTES);
+    for (const char* p = data; p < head_end && (has_vertices == false || has_faces == false);) {
+        const char* end = line_end(p, head_end);
+        const char* s = skip_blanks(p, end);
+        if (s < end && *s == '#') {
+            has_vertices =
+                has_vertices || stated_count(s, end, {"vertices", "verts"}, stated.vertex_count);
+            has_faces =
+                has_faces || stated_count(s, end, {"faces", "triangles"}, stated.face_count);
+        }
+        p = end + 1;
+    }
+    if (has_vertices && has_faces) {
+        return stated;
+    }
+
+    ObjCounts sampled{0, 0};
+    if (size <= SNIFF_SAMPLES * SNIFF_SAMPLE_BYTES) {
+        count_statements(data, file_end, true, sampled);
+    } else {
+        size_t sampled_bytes = 0;
+        for (size_t i = 0; i < SNIFF_SAMPLES; i++) {
+            // Start at the line following the offset
+            const char* p = data + size * i / SNIFF_SAMPLES;
+            if (p != data) {
+                p = line_end(p, file_end) + 1;
+            }
+            if (p >= file_end) {
+                continue;
+            }
+            const char* end = std::min(p + SNIFF_SAMPLE_BYTES, file_end);
+            const char* counted = count_statements(p, end, end == file_end, sampled);
+            sampled_bytes += static_cast<size_t>(counted - p);
+        }
+        if (sampled_bytes > 0) {
+            const double scale = static_cast<double>(size) / static_cast<double>(sampled_bytes);
+            sampled.vertex_count =
+                static_cast<std::uint64_t>(static_cast<double>(sampled.vertex_count) * scale);
+            sampled.face_count =
+                static_cast<std::uint64_t>(static_cast<double>(sampled.face_count) * scale);
+        }
+    }
+    return ObjCounts{has_vertices ? stated.vertex_count : sampled.vertex_count,
+                     has_faces ? stated.face_count : sampled.face_count};
+}
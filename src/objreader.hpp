@@ -0,0 +1,77 @@
+#ifndef OBJREADER_HPP_
+#define OBJREADER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bounds.hpp"
+#include "mappedfile.hpp"
+
+// Range of triangles belonging to one object or group of an OBJ file.
+struct ObjShape {
+    // Offset and length in ObjData::indices
+    std::size_t first_index;
+    std::size_t index_count;
+};
+
+// Geometry read from a Wavefront OBJ file.
+//
+// Only vertex positions, vertex colors and faces are kept.  Faces are triangulated as fans.
+struct ObjData {
+    // Three floats per vertex
+    std::vector<float> positions;
+
+    // Three floats per vertex.  Vertices without colors are white.
+    std::vector<float> colors;
+
+    // Three zero-based vertex indices per triangle
+    std::vector<std::uint32_t> indices;
+
+    // Non-empty shapes in file order, together covering all of indices.
+    // Each `o` or `g` statement starts a new shape.
+    std::vector<ObjShape> shapes;
+};
+
+// Reads the OBJ file at path.
+//
+// The file is memory-mapped, or read with FileAccess::Read, and split into line-aligned chunks,
+// which are parsed in parallel.
+// Throws on I/O errors, malformed numbers and out-of-range indices.
+ObjData read_obj(const std::string& path, FileAccess access = FileAccess::Map);
+
+// Triangles read by stream_obj, with every corner expanded.
+struct ObjBatch {
+    // Three floats per corner
+    std::vector<float> positions;
+    std::vector<float> colors;
+};
+
+// Reads the OBJ file at path front to back on the calling thread, calling emit with batches of
+// batch_size triangles as soon as they are parsed.  The last batch may be smaller.
+// Stops early if emit returns false or cancel is set.
+// Unlike read_obj, faces may only refer to vertices defined before them.
+void stream_obj(const std::string& path, size_t batch_size,
+                const std::function<bool(ObjBatch&)>& emit, const std::atomic<bool>& cancel);
+
+// Estimates the bounds of the vertex positions of the OBJ file from the vertex statements found at
+// sample_count evenly spaced offsets.  The estimate is empty if no vertex statement is hit.
+Bounds sample_obj_bounds(const std::string& path, size_t sample_count);
+
+// Numbers of vertex and face statements of an OBJ file.
+struct ObjCounts {
+    std::uint64_t vertex_count;
+    std::uint64_t face_count;
+};
+
+// Estimates the numbers of statements without parsing the whole file.
+// Counts stated by exporter comments at the head of the file, such as "# Vertices: 8" or
+// "# 12 faces", are used when present.  Otherwise the statements in evenly spaced samples are
+// counted and scaled up to the file size, which is exact for small files.
+// Throws if the file cannot be read.
+ObjCounts sniff_obj_counts(const std::string& path);
+
+#endif
@@ -0,0 +1,323 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <unordered_map>
+
+#include "threadpool.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OCCLUSION_SSE
+#include <immintrin.h>
+#endif
+
+namespace {
+// Occluders with fewer triangles per thread are not worth splitting further
+const size_t MIN_TRIANGLES_PER_THREAD = 2048;
+
+// Bands of fewer rows would mostly set up triangles instead of filling them
+const size_t MIN_ROWS_PER_THREAD = 8;
+
+// Clip space w below which vertices count as behind the camera
+const float MIN_W = 1e-5f;
+
+// A triangle in window space, wound counter-clockwise, with the pixels whose centers its bounding
+// box covers
+struct ScreenTriangle {
+    float x[3];
+    float y[3];
+    float z[3];
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+};
+
+struct ClipVertex {
+    float x;
+    float y;
+    float z;
+    float w;
+};
+
+ClipVertex transform(const Matrix4& m, const float* p) {
+    return ClipVertex{
+        m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3],
+        m[4] * p[0] + m[5] * p[1] + m[6] * p[2] + m[7],
+        m[8] * p[0] + m[9] * p[1] + m[10] * p[2] + m[11],
+        m[12] * p[0] + m[13] * p[1] + m[14] * p[2] + m[15],
+    };
+}
+
+bool in_front_of_near(const ClipVertex& v) { return v.w > MIN_W && v.z >= -v.w; }
+
+// Projects the triangles of the occluder into a buffer of the size, leaving out those crossing the
+// near plane or covering no pixel center
+void setup_triangles(const Occluder& occluder, const Matrix4& mvp, size_t width, size_t height,
+                     std::vector<ScreenTriangle>& triangles) {
+    const auto w = static_cast<float>(width);
+    const auto h = static_cast<float>(height);
+    std::vector<ClipVertex> clip(occluder.positions.size() / 3);
+    for (size_t i = 0; i < clip.size(); i++) {
+        clip[i] = transform(mvp, &occluder.positions[3 * i]);
+    }
+
+    for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+        ScreenTriangle tri;
+        bool clipped = false;
+        for (int corner = 0; corner < 3; corner++) {
+            const ClipVertex& v = clip[occluder.indices[i + corner]];
+            if (in_front_of_near(v) == false) {
+                clipped = true;
+                break;
+            }
+            tri.x[corner] = (v.x / v.w * 0.5f + 0.5f) * w;
+            tri.y[corner] = (v.y / v.w * 0.5f + 0.5f) * h;
+            tri.z[corner] = v.z / v.w * 0.5f + 0.5f;
+        }
+        if (clipped) {
+            continue;
+        }
+
+        const float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) -
+                           (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+        if (area == 0 || std::isfinite(area) == false) {
+            continue;
+        }
+        // Occluders are drawn from both sides
+        if (area < 0) {
+            std::swap(tri.x[1], tri.x[2]);
+            std::swap(tri.y[1], tri.y[2]);
+            std::swap(tri.z[1], tri.z[2]);
+        }
+
+        // Pixel x is covered if its center x + 0.5 is
+        const float min_x = std::min({tri.x[0], tri.x[1], tri.x[2]});
+        const float max_x = std::max({tri.x[0], tri.x[1], tri.x[2]});
+        const float min_y = std::min({tri.y[0], tri.y[1], tri.y[2]});
+        const float max_y = std::max({tri.y[0], tri.y[1], tri.y[2]});
+        tri.min_x = static_cast<int>(std::max(std::ceil(min_x - 0.5f), 0.0f));
+        tri.max_x = static_cast<int>(std::min(std::floor(max_x - 0.5f) + 1, w));
+        tri.min_y = static_cast<int>(std::max(std::ceil(min_y - 0.5f), 0.0f));
+        tri.max_y = static_cast<int>(std::min(std::floor(max_y - 0.5f) + 1, h));
+        if (tri.min_x < tri.max_x && tri.min_y < tri.max_y) {
+            triangles.push_back(tri);
+        }
+    }
+}
+
+// Draws the rows [first_row, last_row) of the triangle, keeping the nearest depth
+void fill(const ScreenTriangle& tri, int first_row, int last_row, float* depth, size_t width) {
+    // Edge i is positive on the inner side of the edge from corner i to the next one
+    float a[3];
+    float b[3];
+    float c[3];
+    for (int i = 0; i < 3; i++) {
+        const int j = (i + 1) % 3;
+        a[i] = tri.y[i] - tri.y[j];
+        b[i] = tri.x[j] - tri.x[i];
+        c[i] = tri.x[i] * tri.y[j] - tri.x[j] * tri.y[i];
+    }
+    const float area = c[0] + c[1] + c[2];
+    const float dzdx = ((tri.z[1] - tri.z[0]) * (tri.y[2] - tri.y[0]) -
+                        (tri.z[2] - tri.z[0]) * (tri.y[1] - tri.y[0])) /
+                       area;
+    const float dzdy = ((tri.x[1] - tri.x[0]) * (tri.z[2] - tri.z[0]) -
+                        (tri.x[2] - tri.x[0]) * (tri.z[1] - tri.z[0])) /
+                       area;
+    const float z0 = tri.z[0] - dzdx * tri.x[0] - dzdy * tri.y[0];
+
+    const int y_begin = std::max(tri.min_y, first_row);
+    const int y_end = std::min(tri.max_y, last_row);
+    // Spans start on multiples of 4, which the rounded up width keeps within the row
+    const int x_begin = tri.min_x & ~3;
+    for (int y = y_begin; y < y_end; y++) {
+        const float py = static_cast<float>(y) + 0.5f;
+        float* row = depth + static_cast<size_t>(y) * width;
+#if defined(OCCLUSION_SSE)
+        const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        for (int x = x_begin; x < tri.max_x; x += 4) {
+            const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int i = 0; i < 3; i++) {
+                const __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[i]), px),
+                                               _mm_set1_ps(b[i] * py + c[i]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+            }
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            const __m128 z =
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * py + z0));
+            const __m128 old = _mm_loadu_ps(row + x);
+            const __m128 nearest = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x,
+                          _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+        }
+#else
+        for (int x = x_begin; x < tri.max_x; x++) {
+            const float px = static_cast<float>(x) + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < 3; i++) {
+                inside = inside && a[i] * px + b[i] * py + c[i] >= 0;
+            }
+            if (inside) {
+                row[x] = std::min(row[x], dzdx * px + dzdy * py + z0);
+            }
+        }
+#endif
+    }
+}
+} // namespace
+
+Occluder make_occluder(const std::vector<std::uint32_t>& indices, const float* positions) {
+    Occluder occluder;
+    occluder.indices.reserve(indices.size());
+    std::unordered_map<std::uint32_t, std::uint32_t> remap;
+    for (const std::uint32_t index : indices) {
+        const auto [it, inserted] =
+            remap.emplace(index, static_cast<std::uint32_t>(occluder.positions.size() / 3));
+        if (inserted) {
+            occluder.positions.insert(occluder.positions.end(), positions + 3 * index,
+                                      positions + 3 * index + 3);
+        }
+        occluder.indices.push_back(it->second);
+    }
+    return occluder;
+}
+
+OcclusionBuffer::OcclusionBuffer(size_t width, size_t height, ThreadPool* pool)
+    : levels(), pool(pool) {
+    size_t w = std::max<size_t>((width + 3) & ~size_t{3}, 4);
+    size_t h = std::max<size_t>(height, 1);
+    levels.push_back(Level{w, h, std::vector<float>(w * h, 1.0f)});
+    while (w > 1 || h > 1) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        levels.push_back(Level{w, h, std::vector<float>(w * h, 1.0f)});
+    }
+}
+
+void OcclusionBuffer::clear() {
+    for (auto& level : levels) {
+        std::fill(level.depth.begin(), level.depth.end(), 1.0f);
+    }
+}
+
+void OcclusionBuffer::rasterize(const Occluder& occluder, const std::vector<Matrix4>& mvps) {
+    Level& target = levels.front();
+    std::vector<ScreenTriangle> triangles;
+    for (const auto& mvp : mvps) {
+        setup_triangles(occluder, mvp, target.width, target.height, triangles);
+    }
+
+    // Every thread draws its own band of rows, so no two write the same pixel
+    const size_t max_threads = std::max<size_t>(
+        std::min<size_t>(std::thread::hardware_concurrency(), target.height / MIN_ROWS_PER_THREAD),
+        1);
+    const size_t threads =
+        std::clamp<size_t>(triangles.size() / MIN_TRIANGLES_PER_THREAD, 1, max_threads);
+    const auto draw_band = [&](size_t t) {
+        const auto first_row = static_cast<int>(target.height * t / threads);
+        const auto last_row = static_cast<int>(target.height * (t + 1) / threads);
+        for (const auto& tri : triangles) {
+            if (tri.max_y > first_row && tri.min_y < last_row) {
+                fill(tri, first_row, last_row, target.depth.data(), target.width);
+            }
+        }
+    };
+    // Runs every frame, so the workers of the pool are reused instead of starting threads
+    if (pool != nullptr) {
+        parallel_for(*pool, threads, draw_band);
+    } else {
+        parallel_for(threads, draw_band);
+    }
+}
+
+void OcclusionBuffer::build_pyramid() {
+    for (size_t k = 1; k < levels.size(); k++) {
+        const Level& below = levels[k - 1];
+        Level& level = levels[k];
+        for (size_t y = 0; y < level.height; y++) {
+            const size_t y0 = 2 * y;
+            const size_t y1 = std::min(2 * y + 1, below.height - 1);
+            for (size_t x = 0; x < level.width; x++) {
+                const size_t x0 = 2 * x;
+                const size_t x1 = std::min(2 * x + 1, below.width - 1);
+                const float* row0 = &below.depth[y0 * below.width];
+                const float* row1 = &below.depth[y1 * below.width];
+                level.depth[y * level.width + x] =
+                    std::max({row0[x0], row0[x1], row1[x0], row1[x1]});
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::box_visible(const Bounds& box, const Matrix4& mvp) const {
+    const Level& base = levels.front();
+    const auto w = static_cast<float>(base.width);
+    const auto h = static_cast<float>(base.height);
+
+    float min_x = w;
+    float max_x = 0;
+    float min_y = h;
+    float max_y = 0;
+    float min_z = 1;
+    for (int corner = 0; corner < 8; corner++) {
+        const float p[3] = {(corner & 1) ? box.max[0] : box.min[0],
+                            (corner & 2) ? box.max[1] : box.min[1],
+                            (corner & 4) ? box.max[2] : box.min[2]};
+        const ClipVertex v = transform(mvp, p);
+        if (in_front_of_near(v) == false) {
+            return true;
+        }
+        const float x = (v.x / v.w * 0.5f + 0.5f) * w;
+        const float y = (v.y / v.w * 0.5f + 0.5f) * h;
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        min_z = std::min(min_z, v.z / v.w * 0.5f + 0.5f);
+    }
+    // Boxes off screen are left to frustum culling
+    if (max_x < 0 || min_x >= w || max_y < 0 || min_y >= h) {
+        return true;
+    }
+
+    // Every pixel the box touches
+    size_t x0 = static_cast<size_t>(std::max(min_x, 0.0f));
+    size_t x1 = std::min(static_cast<size_t>(max_x), base.width - 1);
+    size_t y0 = static_cast<size_t>(std::max(min_y, 0.0f));
+    size_t y1 = std::min(static_cast<size_t>(max_y), base.height - 1);
+
+    // The level where the pixels fall into at most 4x4 texels.  Coarser levels would test fewer
+    // texels, but let more of the unoccluded surroundings in.
+    size_t k = 0;
+    while (k + 1 < levels.size() && (x1 - x0 > 3 || y1 - y0 > 3)) {
+        k++;
+        x0 /= 2;
+        x1 /= 2;
+        y0 /= 2;
+        y1 /= 2;
+    }
+
+    const Level& level = levels[k];
+    for (size_t y = y0; y <= y1; y++) {
+        for (size_t x = x0; x <= x1; x++) {
+            if (min_z <= level.depth[y * level.width + x]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t OcclusionBuffer::width() const { return levels.front().width; }
+size_t OcclusionBuffer::height() const { return levels.front().height; }
+
+float OcclusionBuffer::depth(size_t x, size_t y) const {
+    const Level& base = levels.front();
+    return base.depth[y * base.width + x];
+}
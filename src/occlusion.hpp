@@ -0,0 +1,68 @@
+#ifndef OCCLUSION_HPP_
+#define OCCLUSION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bounds.hpp"
+#include "matrix.hpp"
+
+using std::size_t;
+
+class ThreadPool;
+
+// Triangles drawn into an occlusion buffer in place of a model.
+struct Occluder {
+    // Three floats per vertex, in the model space of the mesh
+    std::vector<float> positions;
+    std::vector<std::uint32_t> indices;
+};
+
+// Returns an occluder holding the triangles, with only the vertices they use.
+// Positions holds three floats per vertex.
+Occluder make_occluder(const std::vector<std::uint32_t>& indices, const float* positions);
+
+// Low resolution depth buffer rasterized on the CPU, with a pyramid of the farthest depth of every
+// 2x2 block of the level below, for testing whether boxes are hidden behind the drawn occluders.
+//
+// Depth is the window space depth in [0, 1], with 1 at the far plane.
+class OcclusionBuffer final {
+  public:
+    // The width is rounded up to a multiple of 4.
+    // Rasterization is split with the workers of the pool if given, which must outlive the buffer.
+    OcclusionBuffer(size_t width, size_t height, ThreadPool* pool = nullptr);
+
+    // Resets the depth to the far plane.
+    void clear();
+
+    // Draws the occluder once for each model-view-projection matrix.
+    // Rows are split between threads for large occluders, and spans of 4 pixels are filled at a
+    // time with SIMD.  Triangles crossing the near plane are left out.
+    void rasterize(const Occluder& occluder, const std::vector<Matrix4>& mvps);
+
+    // Builds the depth pyramid from the depth drawn since the last clear.
+    void build_pyramid();
+
+    // Returns false if the box is certainly hidden behind the drawn occluders, as of the last
+    // build of the pyramid.  Boxes crossing the near plane are always visible.
+    bool box_visible(const Bounds& box, const Matrix4& mvp) const;
+
+    size_t width() const;
+    size_t height() const;
+
+    // Returns the depth of the pixel, with row 0 at the bottom.
+    float depth(size_t x, size_t y) const;
+
+  private:
+    struct Level {
+        size_t width;
+        size_t height;
+        std::vector<float> depth;
+    };
+    // Level 0 holds the depth drawn by rasterize
+    std::vector<Level> levels;
+    ThreadPool* pool;
+};
+
+#endif
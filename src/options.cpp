@@ -0,0 +1,218 @@
+#include "options.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+struct OptionSpec {
+    const char* name;
+    const char* value_hint;
+    const char* description;
+    std::function<void(Options&, std::string_view)> apply;
+};
+
+// Parses a non-negative integer, throwing on anything else
+size_t parse_count(std::string_view name, std::string_view value) {
+    size_t count = 0;
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), count);
+    if (ec != std::errc() || end != value.data() + value.size()) {
+        throw std::runtime_error("Invalid value of --" + std::string(name) + ": " +
+                                 std::string(value));
+    }
+    return count;
+}
+
+// Parses a size of the form `<width>x<height>`, both positive
+std::pair<int, int> parse_size(std::string_view name, std::string_view value) {
+    const auto invalid = [&]() {
+        return std::runtime_error("Invalid value of --" + std::string(name) + ": " +
+                                  std::string(value));
+    };
+    const auto x = value.find('x');
+    if (x == value.npos) {
+        throw invalid();
+    }
+    const size_t width = parse_count(name, value.substr(0, x));
+    const size_t height = parse_count(name, value.substr(x + 1));
+    if (width == 0 || height == 0 || width > 16384 || height > 16384) {
+        throw invalid();
+    }
+    return {static_cast<int>(width), static_cast<int>(height)};
+}
+
+// Parses a number of MiB into bytes, throwing if they do not fit in a size_t
+size_t parse_mebibytes(std::string_view name, std::string_view value) {
+    const size_t mebibytes = parse_count(name, value);
+    if (mebibytes > SIZE_MAX >> 20) {
+        throw std::runtime_error("Invalid value of --" + std::string(name) + ": " +
+                                 std::string(value));
+    }
+    return mebibytes << 20;
+}
+
+// Parses a vector of the form `<x>,<y>,<z>`
+Vector3 parse_vector(std::string_view name, std::string_view value) {
+    Vector3 vec;
+    std::istringstream in{std::string(value)};
+    char comma1 = 0;
+    char comma2 = 0;
+    if (!(in >> vec.x >> comma1 >> vec.y >> comma2 >> vec.z) || comma1 != ',' || comma2 != ',' ||
+        in.peek() != std::char_traits<char>::eof()) {
+        throw std::runtime_error("Invalid value of --" + std::string(name) + ": " +
+                                 std::string(value));
+    }
+    return vec;
+}
+
+// Returns the specs of all supported options
+const std::vector<OptionSpec>& option_specs() {
+    static const std::vector<OptionSpec> specs{
+        {"help", nullptr, "Print this message and exit",
+         [](Options& options, std::string_view) { options.help = true; }},
+        {"model-dir", "path", "Folder of the model files, instead of picking one in a dialog",
+         [](Options& options, std::string_view value) { options.model_dir = value; }},
+        {"parser", "fast|tinyobj", "OBJ parser used to load models (default: fast)",
+         [](Options& options, std::string_view value) {
+             if (value == "fast") {
+                 options.model.parser = ModelOptions::Parser::Fast;
+             } else if (value == "tinyobj") {
+                 options.model.parser = ModelOptions::Parser::Tinyobj;
+             } else {
+                 throw std::runtime_error("Unknown parser " + std::string(value));
+             }
+         }},
+        {"exclude", "pattern",
+         "Skip files and directories whose name matches the glob pattern; may be repeated",
+         [](Options& options, std::string_view value) {
+             options.scan.exclude.emplace_back(value);
+         }},
+        {"rescan", nullptr, "Walk the model folder even if a manifest of it is stored",
+         [](Options& options, std::string_view) { options.scan.rescan = true; }},
+        {"sort", "path|size", "Order of the models (default: path)",
+         [](Options& options, std::string_view value) {
+             if (value == "path") {
+                 options.scan.order = ScanOptions::Order::Path;
+             } else if (value == "size") {
+                 options.scan.order = ScanOptions::Order::Size;
+             } else {
+                 throw std::runtime_error("Unknown order " + std::string(value));
+             }
+         }},
+        {"deindex", nullptr, "Expand every face corner into its own vertex instead of indexing",
+         [](Options& options, std::string_view) { options.model.indexed = false; }},
+        {"optimize", nullptr,
+         "Reorder triangles for the vertex cache and overdraw when loading indexed models",
+         [](Options& options, std::string_view) { options.model.optimize = true; }},
+        {"meshlets", nullptr,
+         "Split indexed models into meshlets and cull them against the view every frame",
+         [](Options& options, std::string_view) { options.model.meshlets = true; }},
+        {"stream", nullptr, "Draw the triangles of large models as they are parsed",
+         [](Options& options, std::string_view) { options.model.stream = true; }},
+        {"no-lod", nullptr, "Do not build coarser levels of detail for distant models",
+         [](Options& options, std::string_view) { options.model.lod = false; }},
+        {"vertex-format", "compact|float",
+         "Vertex buffer packing; compact uses 16-bit positions and 8-bit colors (default: compact)",
+         [](Options& options, std::string_view value) {
+             if (value == "compact") {
+                 options.model.vertex_format = VertexFormat::Compact;
+             } else if (value == "float") {
+                 options.model.vertex_format = VertexFormat::Float;
+             } else {
+                 throw std::runtime_error("Unknown vertex format " + std::string(value));
+             }
+         }},
+        {"instances", "count",
+         "Draw count copies of the current model on a grid with instancing (default: 1)",
+         [](Options& options, std::string_view value) {
+             options.model.instances = std::max<size_t>(parse_count("instances", value), 1);
+         }},
+        {"occlusion", nullptr,
+         "With --instances, cull copies hidden behind the nearest ones on the CPU",
+         [](Options& options, std::string_view) { options.model.occlusion = true; }},
+        {"on-demand", nullptr,
+         "Draw frames only when the view or the models change, waiting for events in between",
+         [](Options& options, std::string_view) { options.on_demand = true; }},
+        {"batch", "dir",
+         "Render every model to a PNG image in dir without a window, then exit",
+         [](Options& options, std::string_view value) { options.batch.output_dir = value; }},
+        {"image-size", "width>x<height",
+         "Size of the images rendered with --batch (default: 800x600)",
+         [](Options& options, std::string_view value) {
+             std::tie(options.batch.width, options.batch.height) =
+                 parse_size("image-size", value);
+         }},
+        {"eye", "x,y,z", "Eye position of the camera of --batch (default: 0,0,2)",
+         [](Options& options, std::string_view value) {
+             options.batch.eyepos = parse_vector("eye", value);
+         }},
+        {"center", "x,y,z", "Viewing center of the camera of --batch (default: 0,0,0)",
+         [](Options& options, std::string_view value) {
+             options.batch.center = parse_vector("center", value);
+         }},
+        {"ortho", nullptr, "Render the images of --batch with orthogonal projection",
+         [](Options& options, std::string_view) { options.batch.orthogonal = true; }},
+        {"no-cache", nullptr, "Always parse model files instead of using the mesh cache",
+         [](Options& options, std::string_view) { options.model.cache = false; }},
+        {"cache-dir", "path", "Directory of the mesh cache (default: $XDG_CACHE_HOME/cg1)",
+         [](Options& options, std::string_view value) { options.model.cache_dir = value; }},
+        {"gpu-budget", "MiB",
+         "GPU memory kept for model buffers; 0 keeps every shown model resident (default: 1024)",
+         [](Options& options, std::string_view value) {
+             options.model.gpu_budget = parse_mebibytes("gpu-budget", value);
+         }},
+    };
+    return specs;
+}
+} // namespace
+
+Options parse_options(int argc, const char* const argv[]) {
+    Options options{};
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if (arg.substr(0, 2) != "--") {
+            throw std::runtime_error("Unexpected argument " + std::string(arg));
+        }
+
+        const auto eq = arg.find('=');
+        const std::string_view name = arg.substr(2, eq == arg.npos ? arg.npos : eq - 2);
+        const std::string_view value = eq == arg.npos ? std::string_view{} : arg.substr(eq + 1);
+
+        bool found = false;
+        for (const auto& spec : option_specs()) {
+            if (name != spec.name) {
+                continue;
+            }
+            if ((spec.value_hint != nullptr) != (eq != arg.npos)) {
+                throw std::runtime_error("Invalid use of option --" + std::string(name));
+            }
+            spec.apply(options, value);
+            found = true;
+        }
+        if (found == false) {
+            throw std::runtime_error("Unknown option --" + std::string(name));
+        }
+    }
+    return options;
+}
+
+std::string options_usage() {
+    std::ostringstream out;
+    out << "Options:\n";
+    for (const auto& spec : option_specs()) {
+        std::string flag = std::string("--") + spec.name;
+        if (spec.value_hint != nullptr) {
+            flag += std::string("=<") + spec.value_hint + ">";
+        }
+        out << "  " << flag << "\n      " << spec.description << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,33 @@
+#ifndef OPTIONS_HPP_
+#define OPTIONS_HPP_
+
+#include <string>
+
+#include "batch.hpp"
+#include "manifest.hpp"
+#include "model.hpp"
+
+// Command line options of the program.
+struct Options {
+    // Print usage and exit
+    bool help = false;
+
+    // Draw frames only when something changed, instead of continuously
+    bool on_demand = false;
+
+    // Folder of the model files, picked in a dialog if empty
+    std::string model_dir;
+
+    ModelOptions model;
+    ScanOptions scan;
+    BatchOptions batch;
+};
+
+// Parses command line options of the form `--name` or `--name=value`.
+// Throws if an option is unknown or its value is invalid.
+Options parse_options(int argc, const char* const argv[]);
+
+// Returns the usage text describing all options.
+std::string options_usage();
+
+#endif
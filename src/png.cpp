@@ -0,0 +1,124 @@
+#include "png.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+const unsigned char PNG_SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+// Largest payload of a stored deflate block
+const size_t STORED_BLOCK_BYTES = 65535;
+
+// CRC-32 lookup table of the polynomial used by PNG chunks
+std::array<std::uint32_t, 256> make_crc_table() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t n = 0; n < 256; n++) {
+        std::uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}
+
+std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, size_t size) {
+    static const std::array<std::uint32_t, 256> table = make_crc_table();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void put_u32(std::vector<unsigned char>& out, std::uint32_t value) {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+void write_chunk(std::ofstream& out, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk;
+    chunk.reserve(data.size() + 12);
+    put_u32(chunk, static_cast<std::uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    // The checksum covers the type and the data
+    put_u32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+    out.write(reinterpret_cast<const char*>(chunk.data()),
+              static_cast<std::streamsize>(chunk.size()));
+}
+
+// Wraps the bytes into a zlib stream of stored deflate blocks
+std::vector<unsigned char> zlib_stored(const std::vector<unsigned char>& raw) {
+    std::vector<unsigned char> out;
+    out.reserve(raw.size() + raw.size() / STORED_BLOCK_BYTES * 5 + 16);
+    // Deflate with a 32 KiB window, no preset dictionary
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    size_t offset = 0;
+    do {
+        const size_t size = std::min(raw.size() - offset, STORED_BLOCK_BYTES);
+        const bool last = offset + size == raw.size();
+        out.push_back(last ? 1 : 0);
+        out.push_back(static_cast<unsigned char>(size));
+        out.push_back(static_cast<unsigned char>(size >> 8));
+        out.push_back(static_cast<unsigned char>(~size));
+        out.push_back(static_cast<unsigned char>(~size >> 8));
+        out.insert(out.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+
+    // Adler-32 of the uncompressed bytes, summed in runs short enough not to overflow
+    std::uint32_t a = 1;
+    std::uint32_t b = 0;
+    for (size_t i = 0; i < raw.size();) {
+        const size_t end = std::min(raw.size(), i + 5552);
+        for (; i < end; i++) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    put_u32(out, (b << 16) | a);
+    return out;
+}
+} // namespace
+
+void write_png(const std::filesystem::path& path, size_t width, size_t height,
+               const std::vector<unsigned char>& rgb) {
+    const size_t row_bytes = width * 3;
+    if (rgb.size() != row_bytes * height) {
+        throw std::runtime_error("Pixel data does not match the image size");
+    }
+
+    std::vector<unsigned char> header;
+    put_u32(header, static_cast<std::uint32_t>(width));
+    put_u32(header, static_cast<std::uint32_t>(height));
+    // 8 bits per channel, RGB, deflate, adaptive filtering, no interlacing
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    // Every row starts with its filter type, which is none
+    std::vector<unsigned char> raw;
+    raw.reserve((row_bytes + 1) * height);
+    for (size_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * row_bytes, rgb.begin() + (y + 1) * row_bytes);
+    }
+
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out.write(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE));
+    write_chunk(out, "IHDR", header);
+    write_chunk(out, "IDAT", zlib_stored(raw));
+    write_chunk(out, "IEND", {});
+    if (out.good() == false) {
+        throw std::runtime_error("Failed to write image " + path.string());
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef PNG_HPP_
+#define PNG_HPP_
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+using std::size_t;
+
+// Writes rows of 8-bit RGB pixels, top row first, as a PNG image.
+// The pixel data is stored without compression, so that no zlib is needed.
+// Throws on I/O errors.
+void write_png(const std::filesystem::path& path, size_t width, size_t height,
+               const std::vector<unsigned char>& rgb);
+
+#endif
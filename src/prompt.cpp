@@ -2,8 +2,6 @@
 
 #include <filesystem>
 #include <iostream>
-#include <string>
-#include <vector>
 
 #include <nfd.hpp>
 
@@ -35,18 +33,4 @@ fs::path prompt_dir() {
     return path;
 }
 
-std::vector<std::string> prompt_model_paths() {
-    std::vector<std::string> model_paths;
-
-    auto dir = prompt_dir();
-
-    // NOTE: Non-recursive directory iterator is used, since otherwise the models from
-    // tinyobjectloader submodule will be loaded, which cause errors.
-    for (auto const& entry : fs::directory_iterator(dir)) {
-        if (entry.path().extension().string() == ".obj") {
-            model_paths.emplace_back(entry.path().string());
-        }
-    }
-
-    return model_paths;
-}
+bool is_model_file(const fs::path& path) { return path.extension().string() == ".obj"; }
@@ -1,10 +1,13 @@
 #ifndef PROMPT_HPP_
 #define PROMPT_HPP_
 
-#include <string>
-#include <vector>
+#include <filesystem>
 
 // Prompts the user to select folder containing model files.
-std::vector<std::string> prompt_model_paths();
+// Falls back to the current directory if no folder is picked.
+std::filesystem::path prompt_dir();
+
+// Returns true if the path names a model file.
+bool is_model_file(const std::filesystem::path& path);
 
 #endif
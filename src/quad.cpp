@@ -0,0 +1,56 @@
+#include "quad.hpp"
+
+#include <array>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "glstate.hpp"
+
+namespace {
+const GLsizei VERTEX_COUNT = 6;
+// The plane lies within [-1, 1], so 16-bit normalized positions are exact enough
+const VertexFormat FORMAT = VertexFormat::Compact;
+} // namespace
+
+Quad::Quad() {
+    const std::array<float, 18> vertices{1.0f,  -0.9f, -1.0f, //
+                                         1.0f,  -0.9f, 1.0f,  //
+                                         -1.0f, -0.9f, -1.0f, //
+                                         1.0f,  -0.9f, 1.0f,  //
+                                         -1.0f, -0.9f, 1.0f,  //
+                                         -1.0f, -0.9f, -1.0f};
+    const std::array<float, 18> colors{0.0f, 1.0f, 0.0f, //
+                                       0.0f, 0.5f, 0.8f, //
+                                       0.0f, 1.0f, 0.0f, //
+                                       0.0f, 0.5f, 0.8f, //
+                                       0.0f, 0.5f, 0.8f, //
+                                       0.0f, 1.0f, 0.0f};
+    const size_t stride = vertex_size(FORMAT);
+    std::vector<unsigned char> interleaved(VERTEX_COUNT * stride);
+    for (GLsizei i = 0; i < VERTEX_COUNT; i++) {
+        pack_vertex(FORMAT, &interleaved.at(i * stride), &vertices.at(i * 3), &colors.at(i * 3));
+    }
+
+    glGenVertexArrays(1, &vao);
+    bind_vertex_array(vao);
+
+    glGenBuffers(1, &this->vertices);
+    bind_buffer(GL_ARRAY_BUFFER, this->vertices);
+    glBufferData(GL_ARRAY_BUFFER, interleaved.size(), interleaved.data(), GL_STATIC_DRAW);
+    set_vertex_attributes(FORMAT);
+}
+
+Quad::~Quad() {
+    delete_buffer(vertices);
+    delete_vertex_array(vao);
+}
+
+void Quad::draw(const DrawContext&) const {
+    bind_vertex_array(vao);
+    glDrawArrays(GL_TRIANGLES, 0, VERTEX_COUNT);
+}
+
+unsigned int Quad::vertex_array() const { return vao; }
+
+std::optional<Bounds> Quad::bounds() const { return Bounds{{-1, -0.9f, -1}, {1, -0.9f, 1}}; }
@@ -0,0 +1,28 @@
+#ifndef QUAD_HPP_
+#define QUAD_HPP_
+
+#include "drawable.hpp"
+#include "vertex.hpp"
+
+// The blue-greenish plane to be rendered below the model.
+class Quad final : public Drawable {
+  public:
+    Quad();
+    ~Quad();
+
+    // Prevent copy and move
+    Quad(const Quad&) = delete;
+    Quad& operator=(const Quad&) = delete;
+    Quad(Quad&&) = delete;
+    Quad& operator=(Quad&&) = delete;
+
+    virtual void draw(const DrawContext& context) const override;
+    virtual unsigned int vertex_array() const override;
+    virtual std::optional<Bounds> bounds() const override;
+
+  private:
+    unsigned int vao;
+    unsigned int vertices;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "renderqueue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "glstate.hpp"
+
+namespace {
+// Bits of the sort key, from the most significant field down.  The fields wrap around beyond their
+// width, which only costs grouping, never correctness.
+const int LAYER_BITS = 8;
+const int SHADER_BITS = 8;
+const int VERTEX_ARRAY_BITS = 16;
+const int DEPTH_BITS = 30;
+
+std::uint64_t field(std::uint64_t value, int bits) {
+    return value & ((std::uint64_t{1} << bits) - 1);
+}
+
+// Returns the depth as an integer growing with the distance from the camera
+std::uint64_t depth_key(float depth) {
+    // The bit patterns of non-negative floats sort like the floats, and the sign bit is zero, so
+    // dropping the lowest bit leaves the order intact
+    if (!(depth > 0)) {
+        return 0;
+    }
+    std::uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 1;
+}
+
+// Layout of the DRAW_CONSTANTS_BLOCK, following the std140 rules
+struct DrawConstants {
+    // Column-major
+    float mvp[16];
+};
+static_assert(sizeof(DrawConstants) == DRAW_CONSTANTS_BLOCK.size, "Draw constants out of sync");
+
+DrawConstants draw_constants(const DrawContext& context) {
+    DrawConstants constants;
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            constants.mvp[4 * column + row] = context.mvp[4 * row + column];
+        }
+    }
+    return constants;
+}
+
+std::uint64_t sort_key(const RenderState& state, float depth) {
+    std::uint64_t key = field(state.layer, LAYER_BITS);
+    key = (key << SHADER_BITS) | field(state.shader_index, SHADER_BITS);
+    key = (key << VERTEX_ARRAY_BITS) | field(state.vertex_array, VERTEX_ARRAY_BITS);
+    key = (key << 1) | (state.wireframe ? 1 : 0);
+    key = (key << 1) | (state.cull_backfaces ? 1 : 0);
+    return (key << DEPTH_BITS) | depth_key(depth);
+}
+} // namespace
+
+RenderQueue::RenderQueue() : items(), offsets(), ring() {}
+
+void RenderQueue::submit(const RenderState& state, const Drawable& drawable,
+                         const DrawContext& context) {
+    // Clip space w of the model space origin, which grows with the distance in front of the camera
+    const float depth = context.mvp[15];
+    items.push_back({sort_key(state, depth), state, &drawable, context});
+}
+
+void RenderQueue::flush() {
+    // Stable, so that items with equal keys keep the order they were submitted in
+    std::stable_sort(items.begin(), items.end(), [](const RenderItem& a, const RenderItem& b) {
+        return a.key < b.key;
+    });
+
+    ring.begin_frame();
+    offsets.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        const DrawConstants constants = draw_constants(items[i].context);
+        offsets[i] = ring.push(&constants, sizeof(constants));
+    }
+    ring.upload();
+
+    // Sorted items share most of their state with the previous one, which the state cache skips
+    for (size_t i = 0; i < items.size(); i++) {
+        const RenderItem& item = items[i];
+        const RenderState& state = item.state;
+        state.shader->use();
+        set_polygon_mode(state.wireframe ? GL_LINE : GL_FILL);
+        set_enabled(GL_CULL_FACE, state.cull_backfaces);
+        ring.bind(DRAW_CONSTANTS_BINDING, offsets[i], sizeof(DrawConstants));
+        item.drawable->draw(item.context);
+    }
+    ring.end_frame();
+
+    last_item_count = items.size();
+    items.clear();
+}
+
+size_t RenderQueue::item_count() const { return last_item_count; }
@@ -0,0 +1,72 @@
+#ifndef RENDERQUEUE_HPP_
+#define RENDERQUEUE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "drawable.hpp"
+#include "shader.hpp"
+#include "uniformring.hpp"
+
+using std::size_t;
+
+// Uniform block holding the constants of each draw, as declared by the shaders: a single mat4.
+constexpr UniformBlockDecl DRAW_CONSTANTS_BLOCK{"DrawConstants", 16 * sizeof(float)};
+const unsigned int DRAW_CONSTANTS_BINDING = 0;
+
+// GL state a drawable is drawn with, in the order render items are sorted by.
+struct RenderState {
+    // Index of the scene layer, drawn in ascending order
+    size_t layer = 0;
+
+    // Index of the shader among those of the scene, and the shader itself
+    size_t shader_index = 0;
+    Shader* shader = nullptr;
+
+    // Vertex array object the drawable is mostly drawn with, 0 if unknown
+    unsigned int vertex_array = 0;
+
+    bool wireframe = false;
+    bool cull_backfaces = false;
+};
+
+// A drawable submitted for the frame, with the key it is sorted by.
+struct RenderItem {
+    std::uint64_t key;
+    RenderState state;
+    const Drawable* drawable;
+    DrawContext context;
+};
+
+// Draw calls of a frame, sorted to group draws sharing GL state.
+//
+// Items are sorted by layer, shader, vertex array, polygon mode and culling, and then front to back
+// by the depth of their origin, so that opaque geometry drawn earlier rejects hidden fragments by
+// the early depth test.
+//
+// The constants of all items are written to a uniform buffer ring once per flush, and every draw
+// binds its own range of it to the DRAW_CONSTANTS_BLOCK of the shaders.
+class RenderQueue final {
+  public:
+    RenderQueue();
+
+    // Records a draw of the drawable with the state and context.
+    // The drawable must live until the queue is flushed.
+    void submit(const RenderState& state, const Drawable& drawable, const DrawContext& context);
+
+    // Sorts the submitted items, uploads their constants, and draws them.  Empties the queue.
+    void flush();
+
+    // Number of items drawn by the last flush.
+    size_t item_count() const;
+
+  private:
+    std::vector<RenderItem> items;
+    // Offset of the constants of each item within the frame of the ring
+    std::vector<size_t> offsets;
+    UniformRing ring;
+    size_t last_item_count = 0;
+};
+
+#endif
@@ -6,12 +6,17 @@ const std::string SHADER_VS = R"(
 
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec3 in_color;
+// Model matrix of the instance, the identity when not drawing instances
+layout (location = 2) in mat4 in_instance;
 
 out vec3 vertex_color;
-uniform mat4 mvp;
+// Constants of the draw, selected from the uniform buffer ring of the frame
+layout (std140) uniform DrawConstants {
+	mat4 mvp;
+};
 
 void main() {
-	gl_Position = mvp * vec4(in_pos, 1.0f);
+	gl_Position = mvp * in_instance * vec4(in_pos, 1.0f);
 	vertex_color = in_color;
 }
 
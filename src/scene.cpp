@@ -1,48 +1,62 @@
 #include "scene.hpp"
 
 #include <algorithm>
-#include <array>
 #include <cmath>
+#include <iostream>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <glad/glad.h>
 
+#include "bvh.hpp"
 #include "drawable.hpp"
+#include "glstate.hpp"
 #include "matrix.hpp"
+#include "meshlet.hpp"
+#include "renderqueue.hpp"
 #include "shader.hpp"
 #include "transform/transform.hpp"
-
-// The blue-greenish plane to be rendered below the model.
-class Quad : public Drawable {
-  public:
-    Quad();
-    ~Quad();
-    virtual void draw() const override;
-
-    static const GLsizei VERTEX_COUNT;
-
-  private:
-    GLuint vao;
-    GLuint vertices;
-    GLuint colors;
-};
+#include "vertex.hpp"
+
+namespace {
+// Models are normalized into [-1, 1] on every axis, so this sphere around the origin bounds them
+const float MODEL_BOUNDING_RADIUS = 1.7320508f;
+
+// Returns the on-screen diameter in pixels of the sphere of given radius around the model space
+// origin, or infinity if the camera is inside it.
+float projected_size(const Matrix4& mvp, float radius, float viewport_height) {
+    // Row 3 gives the clip space w of the center, row 1 the largest change of clip space y over
+    // the sphere
+    const float w = mvp[15];
+    const float dy = radius * std::sqrt(mvp[4] * mvp[4] + mvp[5] * mvp[5] + mvp[6] * mvp[6]);
+    const float dw = radius * std::sqrt(mvp[12] * mvp[12] + mvp[13] * mvp[13] + mvp[14] * mvp[14]);
+    if (w - dw <= 0) {
+        return std::numeric_limits<float>::infinity();
+    }
+    // NDC spans 2 units over the viewport height
+    return dy / (w - dw) * viewport_height;
+}
+} // namespace
 
 class Scene::Impl {
   public:
-    Impl(Shader shader, Vector3 clear_color, std::unique_ptr<Drawable> drawable)
-        : shader(std::move(shader)), clear_color(clear_color), drawable(std::move(drawable)),
-          mode(RenderMode::Solid), quad() {}
+    Impl(Shader shader, Vector3 clear_color)
+        : clear_color(clear_color), mode(RenderMode::Solid), cull_backfaces(false),
+          drawable_count(0), culled_count(0), frame_gl_calls(), dirty(true) {
+        add_shader(std::move(shader));
+        // Models and the floor are drawn without instances unless a drawable sets them up
+        reset_instance_matrix();
+    }
 
     class RenderMode {
       public:
         enum Value { Solid, Wireframe };
         RenderMode(Value value) : value(value) {}
-        GLenum mode() const {
-            constexpr std::array<GLenum, 2> data{GL_FILL, GL_LINE};
-            return data[value];
-        }
         constexpr operator Value() const { return value; }
         explicit operator bool() = delete;
 
@@ -50,55 +64,144 @@ class Scene::Impl {
         Value value;
     };
 
-    void render(const Window& window, StagedTransform& transform);
+    size_t add_shader(Shader shader);
+    void add_layer(std::string name, const LayerOptions& options, size_t shader);
+    void add(std::string_view layer, std::unique_ptr<Drawable> drawable);
+    void render(const GlContext& context, StagedTransform& transform);
     void switch_render_mode();
+    bool toggle_backface_culling();
+    bool take_dirty();
+    void debug_print() const;
+
+    std::vector<std::unique_ptr<Shader>> shaders;
 
   private:
-    Shader shader;
+    struct Layer {
+        std::string name;
+        LayerOptions options;
+        size_t shader;
+        std::vector<std::unique_ptr<Drawable>> drawables;
+    };
+
     Vector3 clear_color;
     RenderMode mode;
-    std::unique_ptr<Drawable> drawable;
-    Quad quad;
+    bool cull_backfaces;
+    std::vector<Layer> layers;
+    RenderQueue queue;
+
+    // Drawables submitted in the last frame, and those skipped for being outside the view
+    size_t drawable_count;
+    size_t culled_count;
 
-    void draw_model(const StagedTransform& transform);
-    void draw_floor(const StagedTransform& transform);
+    // State changing GL calls of the last frame
+    GlStateStats frame_gl_calls;
+
+    // Whether the layers or render modes changed since the last call to take_dirty
+    bool dirty;
+
+    void submit(size_t index, const StagedTransform& transform, float viewport_height);
 };
 
-Scene::Scene(Shader shader, Vector3 clear_color, std::unique_ptr<Drawable> drawable)
-    : impl(std::make_unique<Impl>(std::move(shader), clear_color, std::move(drawable))) {}
+Scene::Scene(Shader shader, Vector3 clear_color)
+    : impl(std::make_unique<Impl>(std::move(shader), clear_color)) {}
 Scene::~Scene() = default;
 
-void Scene::render(const Window& window, StagedTransform& transform) {
-    impl->render(window, transform);
+void Scene::add_layer(std::string name, const LayerOptions& options) {
+    impl->add_layer(std::move(name), options, 0);
+}
+void Scene::add_layer(std::string name, const LayerOptions& options, Shader shader) {
+    impl->add_layer(std::move(name), options, impl->add_shader(std::move(shader)));
+}
+size_t Scene::Impl::add_shader(Shader shader) {
+    // Draw constants come from the uniform buffer ring of the render queue
+    shader.bind_uniform_block(DRAW_CONSTANTS_BLOCK, DRAW_CONSTANTS_BINDING);
+    shaders.push_back(std::make_unique<Shader>(std::move(shader)));
+    return shaders.size() - 1;
+}
+void Scene::Impl::add_layer(std::string name, const LayerOptions& options, size_t shader) {
+    const bool exists = std::any_of(layers.begin(), layers.end(),
+                                    [&](const Layer& layer) { return layer.name == name; });
+    if (exists) {
+        throw std::runtime_error("Scene layer " + name + " already exists");
+    }
+    layers.push_back({std::move(name), options, shader, {}});
+}
+
+void Scene::add(std::string_view layer, std::unique_ptr<Drawable> drawable) {
+    impl->add(layer, std::move(drawable));
 }
-void Scene::Impl::render(const Window& window, StagedTransform& transform) {
-    window.make_current();
+void Scene::Impl::add(std::string_view layer, std::unique_ptr<Drawable> drawable) {
+    const auto it = std::find_if(layers.begin(), layers.end(),
+                                 [&](const Layer& candidate) { return candidate.name == layer; });
+    if (it == layers.end()) {
+        throw std::runtime_error("No scene layer named " + std::string(layer));
+    }
+    it->drawables.push_back(std::move(drawable));
+    dirty = true;
+}
+
+void Scene::render(const GlContext& context, StagedTransform& transform) {
+    impl->render(context, transform);
+}
+void Scene::Impl::render(const GlContext& context, StagedTransform& transform) {
+    context.make_current();
+
+    const GlStateStats before = gl_state_stats();
 
     // clear canvas
-    glEnable(GL_DEPTH_TEST);
-    glClearColor(clear_color.x, clear_color.y, clear_color.z, 1.0f);
+    set_enabled(GL_DEPTH_TEST, true);
+    set_clear_color(clear_color.x, clear_color.y, clear_color.z, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-    // Draw model with user-specified mode
-    glPolygonMode(GL_FRONT_AND_BACK, mode.mode());
-    draw_model(transform);
+    // The viewport height picks the level of detail drawn by models
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
 
-    // Always draw floor with filled mode
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    draw_floor(transform);
+    drawable_count = 0;
+    culled_count = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        submit(i, transform, static_cast<float>(viewport[3]));
+    }
+    queue.flush();
+
+    const GlStateStats after = gl_state_stats();
+    frame_gl_calls.issued = after.issued - before.issued;
+    frame_gl_calls.skipped = after.skipped - before.skipped;
 }
 
-void Scene::Impl::draw_model(const StagedTransform& transform) {
-    const Matrix4 mvp = transform.matrix();
+void Scene::Impl::submit(size_t index, const StagedTransform& transform, float viewport_height) {
+    const Layer& layer = layers.at(index);
 
-    shader.set_uniform("mvp", mvp);
-    drawable->draw();
-}
+    DrawContext context;
+    if (layer.options.model_transform) {
+        context.mvp = transform.matrix();
+        context.screen_size = projected_size(context.mvp, MODEL_BOUNDING_RADIUS, viewport_height);
+    } else {
+        context.mvp = transform.view_project_matrix();
+    }
 
-void Scene::Impl::draw_floor(const StagedTransform& transform) {
-    const Matrix4 vp = transform.view_project_matrix();
-    shader.set_uniform("mvp", vp);
-    quad.draw();
+    RenderState state;
+    state.layer = index;
+    state.shader_index = layer.shader;
+    state.shader = shaders.at(layer.shader).get();
+    // Layers without the user render mode are always drawn filled, from both sides
+    if (layer.options.user_render_mode) {
+        state.wireframe = mode == RenderMode::Wireframe;
+        state.cull_backfaces = cull_backfaces;
+    }
+    context.cull_backfaces = state.cull_backfaces;
+
+    const CullView view = cull_view(context.mvp);
+    for (const auto& drawable : layer.drawables) {
+        drawable_count++;
+        const std::optional<Bounds> bounds = drawable->bounds();
+        if (bounds.has_value() && box_visible(*bounds, view) == false) {
+            culled_count++;
+            continue;
+        }
+        state.vertex_array = drawable->vertex_array();
+        queue.submit(state, *drawable, context);
+    }
 }
 
 void Scene::switch_render_mode() { impl->switch_render_mode(); }
@@ -111,48 +214,24 @@ void Scene::Impl::switch_render_mode() {
         mode = RenderMode::Solid;
         break;
     }
+    dirty = true;
 }
 
-Quad::Quad() {
-    const std::array<float, 18> vertices{1.0f,  -0.9f, -1.0f, //
-                                         1.0f,  -0.9f, 1.0f,  //
-                                         -1.0f, -0.9f, -1.0f, //
-                                         1.0f,  -0.9f, 1.0f,  //
-                                         -1.0f, -0.9f, 1.0f,  //
-                                         -1.0f, -0.9f, -1.0f};
-    const std::array<float, 18> colors{0.0f, 1.0f, 0.0f, //
-                                       0.0f, 0.5f, 0.8f, //
-                                       0.0f, 1.0f, 0.0f, //
-                                       0.0f, 0.5f, 0.8f, //
-                                       0.0f, 0.5f, 0.8f, //
-                                       0.0f, 1.0f, 0.0f};
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    glGenBuffers(1, &this->vertices);
-    glBindBuffer(GL_ARRAY_BUFFER, (this->vertices));
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), &vertices.at(0),
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glGenBuffers(1, &this->colors);
-    glBindBuffer(GL_ARRAY_BUFFER, this->colors);
-    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(GLfloat), &colors.at(0), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+bool Scene::toggle_backface_culling() { return impl->toggle_backface_culling(); }
+bool Scene::Impl::toggle_backface_culling() {
+    cull_backfaces = !cull_backfaces;
+    dirty = true;
+    return cull_backfaces;
 }
 
-Quad::~Quad() {
-    glDeleteBuffers(1, &vertices);
-    glDeleteBuffers(1, &colors);
-    glDeleteVertexArrays(1, &vao);
-}
+bool Scene::take_dirty() { return impl->take_dirty(); }
+bool Scene::Impl::take_dirty() { return std::exchange(dirty, false); }
 
-void Quad::draw() const {
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, Quad::VERTEX_COUNT);
+void Scene::debug_print() const { impl->debug_print(); }
+void Scene::Impl::debug_print() const {
+    std::cout << "Drawables visible: " << drawable_count - culled_count << " of "
+              << drawable_count << "\n";
+    std::cout << "Render queue: " << queue.item_count() << " draws\n"
+              << "GL state calls: " << frame_gl_calls.issued << " issued, "
+              << frame_gl_calls.skipped << " skipped as redundant\n";
 }
-
-const GLsizei Quad::VERTEX_COUNT = 6;
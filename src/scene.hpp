@@ -2,16 +2,32 @@
 #define SCENE_HPP_
 
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include "drawable.hpp"
+#include "glcontext.hpp"
 #include "shader.hpp"
 #include "transform/transform.hpp"
-#include "window.hpp"
 
-// TODO: Break scene into layers
+// Render state shared by the drawables of a scene layer.
+struct LayerOptions {
+    // Whether drawables are placed by the model transform, or only by the view and projection
+    bool model_transform = true;
+
+    // Whether the wireframe and backface culling toggles of the scene apply, or the layer is
+    // always drawn filled from both sides
+    bool user_render_mode = true;
+};
+
+// Named layers of drawables, drawn in the order they were added.
+//
+// Every frame, each drawable submits a render item to a queue, which is sorted to group items of
+// the same layer, shader, vertex array and polygon mode, and to draw them front to back within the
+// groups.
 class Scene final {
   public:
-    Scene(Shader shader, Vector3 clear_color, std::unique_ptr<Drawable> drawable);
+    Scene(Shader shader, Vector3 clear_color);
     ~Scene();
 
     // Prevent copy, allow move
@@ -20,12 +36,35 @@ class Scene final {
     Scene(Scene&&) = default;
     Scene& operator=(Scene&&) = default;
 
-    // Renders the scene with specified transforms
-    void render(const Window& window, StagedTransform& transform);
+    // Appends a layer drawn after the existing ones, with the shader of the scene.
+    // Throws if a layer with the name exists.
+    void add_layer(std::string name, const LayerOptions& options = {});
+
+    // Appends a layer drawn after the existing ones, with its own shader.
+    // Throws if a layer with the name exists.
+    void add_layer(std::string name, const LayerOptions& options, Shader shader);
+
+    // Adds a drawable to the layer with the name.
+    // Throws if there is no such layer.
+    void add(std::string_view layer, std::unique_ptr<Drawable> drawable);
+
+    // Renders the scene with specified transforms into the framebuffer of the context
+    void render(const GlContext& context, StagedTransform& transform);
 
     // Switches between wireframe and solid rendering.
     void switch_render_mode();
 
+    // Toggles culling of the back faces of the model.
+    // Returns true if back faces are culled after the toggle.
+    bool toggle_backface_culling();
+
+    // Returns true if drawables or render modes changed since the last call.
+    bool take_dirty();
+
+    // Prints the numbers of draws and of issued and skipped GL state calls of the last frame to
+    // standard output.
+    void debug_print() const;
+
   private:
     class Impl;
     std::unique_ptr<Impl> impl;
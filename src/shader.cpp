@@ -1,35 +1,109 @@
 #include "shader.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 #include <glad/glad.h>
 
-#include "window.hpp"
+#include "glcontext.hpp"
+#include "glstate.hpp"
+
+const unsigned int UniformType<float>::GL_TYPE = GL_FLOAT;
+const unsigned int UniformType<int>::GL_TYPE = GL_INT;
+const unsigned int UniformType<Vector3>::GL_TYPE = GL_FLOAT_VEC3;
+const unsigned int UniformType<Vector4>::GL_TYPE = GL_FLOAT_VEC4;
+const unsigned int UniformType<Matrix4>::GL_TYPE = GL_FLOAT_MAT4;
+
+namespace {
+bool is_sampler(GLenum type) {
+    switch (type) {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_1D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_SAMPLER_BUFFER:
+    case GL_SAMPLER_2D_RECT:
+    case GL_SAMPLER_2D_RECT_SHADOW:
+    case GL_INT_SAMPLER_1D:
+    case GL_INT_SAMPLER_2D:
+    case GL_INT_SAMPLER_3D:
+    case GL_INT_SAMPLER_CUBE:
+    case GL_INT_SAMPLER_1D_ARRAY:
+    case GL_INT_SAMPLER_2D_ARRAY:
+    case GL_INT_SAMPLER_2D_MULTISAMPLE:
+    case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D_RECT:
+    case GL_UNSIGNED_INT_SAMPLER_1D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_3D:
+    case GL_UNSIGNED_INT_SAMPLER_CUBE:
+    case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+    case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+        return true;
+    default:
+        return false;
+    }
+}
+} // namespace
 
 class Shader::Impl {
   public:
-    Impl(GLuint program) : program(program), uniform_locations() {}
-    ~Impl() { glDeleteProgram(program); }
+    Impl(GLuint program) : program(program), uniforms(), blocks() { reflect(); }
+    ~Impl() { delete_program(program); }
 
     Impl(const Impl&) = delete;
     Impl& operator=(const Impl&) = delete;
 
+    void use();
+    void bind_uniform_block(const UniformBlockDecl& block, unsigned int binding);
     void set_uniform(std::string_view name, const Matrix4& mat);
-    GLint uniform_location(std::string_view name);
+    GLint uniform_location(std::string_view name, GLenum type) const;
 
   private:
+    struct ActiveUniform {
+        std::string name;
+        GLenum type;
+        GLint location;
+    };
+
+    struct ActiveBlock {
+        std::string name;
+        GLuint index;
+        GLint size;
+    };
+
     GLuint program;
 
-    // Internal cache for uniform locations
-    std::unordered_map<std::string, GLint> uniform_locations;
+    // Uniforms outside of uniform blocks, sorted by name
+    std::vector<ActiveUniform> uniforms;
+    // Uniform blocks, sorted by name
+    std::vector<ActiveBlock> blocks;
+
+    void reflect();
+    void reflect_blocks();
+    const ActiveUniform& find(std::string_view name) const;
 };
 void Shader::ImplDeleter::operator()(Impl* ptr) const { delete ptr; }
 
-Shader::Shader(const Window& window, std::string_view vertex_shader_src,
+Shader::Shader(const GlContext& context, std::string_view vertex_shader_src,
                std::string_view fragment_shader_src) {
-    window.make_current();
+    context.make_current();
 
     GLuint v, f;
 
@@ -83,33 +157,125 @@ Shader::Shader(const Window& window, std::string_view vertex_shader_src,
 
     glDeleteShader(v);
     glDeleteShader(f);
-    glUseProgram(p);
+    use_program(p);
 
     impl = std::unique_ptr<Impl, ImplDeleter>(new Impl(p));
 }
 Shader::~Shader() {}
 
+void Shader::use() { impl->use(); }
+void Shader::Impl::use() { use_program(program); }
+
+void Shader::bind_uniform_block(const UniformBlockDecl& block, unsigned int binding) {
+    impl->bind_uniform_block(block, binding);
+}
+void Shader::Impl::bind_uniform_block(const UniformBlockDecl& block, unsigned int binding) {
+    const auto it = std::lower_bound(
+        blocks.begin(), blocks.end(), block.name,
+        [](const ActiveBlock& active, std::string_view key) { return active.name < key; });
+    if (it == blocks.end() || it->name != block.name) {
+        throw std::runtime_error("Uniform block with name " + std::string(block.name) +
+                                 " not found in shader program\n");
+    }
+    // Reading past the bound range is undefined, so the shader may not expect more
+    if (static_cast<size_t>(it->size) > block.size) {
+        throw std::runtime_error("Uniform block with name " + it->name + " holds " +
+                                 std::to_string(it->size) + " bytes in shader program, not " +
+                                 std::to_string(block.size) + "\n");
+    }
+    glUniformBlockBinding(program, it->index, binding);
+}
+
 void Shader::set_uniform(std::string_view name, const Matrix4& mat) {
     impl->set_uniform(name, mat);
 }
 void Shader::Impl::set_uniform(std::string_view name, const Matrix4& mat) {
-    const GLint loc = uniform_location(name);
-    glUniformMatrix4fv(loc, 1, GL_TRUE, mat.data());
+    set_uniform_value(uniform_location(name, GL_FLOAT_MAT4), mat);
+}
+
+int Shader::uniform_location(std::string_view name, unsigned int gl_type) const {
+    return impl->uniform_location(name, gl_type);
+}
+GLint Shader::Impl::uniform_location(std::string_view name, GLenum type) const {
+    const ActiveUniform& uniform = find(name);
+    const bool matches = uniform.type == type || (type == GL_INT && is_sampler(uniform.type));
+    if (matches == false) {
+        throw std::runtime_error(std::string("Uniform with name ") + std::string(name) +
+                                 " has another type in shader program\n");
+    }
+    return uniform.location;
 }
 
-GLint Shader::Impl::uniform_location(std::string_view name) {
-    const auto it = uniform_locations.find(name.data());
-    if (it == uniform_locations.end()) {
-        // Cache miss, get and insert
-        const GLint loc = glGetUniformLocation(program, static_cast<const GLchar*>(name.data()));
-        if (loc == -1) {
-            throw std::runtime_error(std::string("Uniform with name ") + name.data() +
-                                     " not found in shader program\n");
+void Shader::Impl::reflect() {
+    GLint count = 0;
+    GLint max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::vector<GLchar> name(static_cast<size_t>(std::max(max_length, 1)));
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()),
+                           &length, &size, &type, name.data());
+        // Members of uniform blocks have no location
+        const GLint location = glGetUniformLocation(program, name.data());
+        if (location == -1) {
+            continue;
+        }
+        std::string key(name.data(), static_cast<size_t>(length));
+        // Arrays are reported as their first element
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+            key.resize(key.size() - 3);
         }
-        uniform_locations.insert({name.data(), loc});
-        return loc;
-    } else {
-        // Cache hit, return cached value
-        return it->second;
+        uniforms.push_back(ActiveUniform{std::move(key), type, location});
+    }
+    std::sort(uniforms.begin(), uniforms.end(),
+              [](const ActiveUniform& a, const ActiveUniform& b) { return a.name < b.name; });
+    reflect_blocks();
+}
+
+void Shader::Impl::reflect_blocks() {
+    GLint count = 0;
+    GLint max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+
+    std::vector<GLchar> name(static_cast<size_t>(std::max(max_length, 1)));
+    for (GLint i = 0; i < count; i++) {
+        const auto index = static_cast<GLuint>(i);
+        GLsizei length = 0;
+        GLint size = 0;
+        glGetActiveUniformBlockName(program, index, static_cast<GLsizei>(name.size()), &length,
+                                    name.data());
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        blocks.push_back(ActiveBlock{std::string(name.data(), static_cast<size_t>(length)), index,
+                                     size});
     }
+    std::sort(blocks.begin(), blocks.end(),
+              [](const ActiveBlock& a, const ActiveBlock& b) { return a.name < b.name; });
+}
+
+const Shader::Impl::ActiveUniform& Shader::Impl::find(std::string_view name) const {
+    const auto it = std::lower_bound(
+        uniforms.begin(), uniforms.end(), name,
+        [](const ActiveUniform& uniform, std::string_view key) { return uniform.name < key; });
+    if (it == uniforms.end() || it->name != name) {
+        throw std::runtime_error(std::string("Uniform with name ") + std::string(name) +
+                                 " not found in shader program\n");
+    }
+    return *it;
+}
+
+void set_uniform_value(int location, float value) { glUniform1f(location, value); }
+void set_uniform_value(int location, int value) { glUniform1i(location, value); }
+void set_uniform_value(int location, const Vector3& value) {
+    glUniform3f(location, value.x, value.y, value.z);
+}
+void set_uniform_value(int location, const Vector4& value) {
+    glUniform4f(location, value.x, value.y, value.z, value.w);
+}
+void set_uniform_value(int location, const Matrix4& value) {
+    glUniformMatrix4fv(location, 1, GL_TRUE, value.data());
 }
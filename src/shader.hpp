@@ -1,17 +1,80 @@
 #ifndef SHADER_HPP_
 #define SHADER_HPP_
 
+#include <cstddef>
 #include <memory>
 #include <string_view>
 
 #include "matrix.hpp"
+#include "vector.hpp"
 
-class Window;
+class GlContext;
+
+// GL type of uniforms of type T.
+// Only specialized for the supported types, so that declaring a uniform of any other type fails to
+// compile.
+template <typename T> struct UniformType;
+template <> struct UniformType<float> {
+    static const unsigned int GL_TYPE;
+};
+template <> struct UniformType<int> {
+    // Also matches samplers, which are set like ints
+    static const unsigned int GL_TYPE;
+};
+template <> struct UniformType<Vector3> {
+    static const unsigned int GL_TYPE;
+};
+template <> struct UniformType<Vector4> {
+    static const unsigned int GL_TYPE;
+};
+template <> struct UniformType<Matrix4> {
+    static const unsigned int GL_TYPE;
+};
+
+// Name and type of a uniform a shader is expected to have, for declaring it as a constant:
+//
+//     constexpr UniformDecl<Matrix4> MODEL_MATRIX{"model"};
+template <typename T> struct UniformDecl {
+    static_assert(sizeof(UniformType<T>) > 0, "Unsupported uniform type");
+    std::string_view name;
+};
+
+// Name of a std140 uniform block a shader is expected to have, and the size of the buffer ranges
+// bound to it, for declaring it as a constant:
+//
+//     constexpr UniformBlockDecl CAMERA_BLOCK{"Camera", sizeof(CameraConstants)};
+struct UniformBlockDecl {
+    std::string_view name;
+    std::size_t size;
+};
+
+// Sets the value of the uniform at the location of the program in use.
+// The input matrix should be stored row-major.
+void set_uniform_value(int location, float value);
+void set_uniform_value(int location, int value);
+void set_uniform_value(int location, const Vector3& value);
+void set_uniform_value(int location, const Vector4& value);
+void set_uniform_value(int location, const Matrix4& value);
+
+// Pre-resolved location of a uniform of type T, setting it without looking up its name.
+// Only valid for the shader it was obtained from, while that shader is in use.
+template <typename T> class UniformHandle final {
+  public:
+    void set(const T& value) const { set_uniform_value(location, value); }
+
+  private:
+    friend class Shader;
+    explicit UniformHandle(int location) : location(location) {}
+    int location;
+};
 
 // Wrapper class for compiled OpenGL shader program objects.
+//
+// The active uniforms and uniform blocks of the program are reflected once it is linked.  Uniforms
+// are handed out as typed handles by uniform, and blocks are checked against their declarations.
 class Shader final {
   public:
-    Shader(const Window& window, std::string_view vertex_shader_src,
+    Shader(const GlContext& context, std::string_view vertex_shader_src,
            std::string_view fragment_shader_src);
     ~Shader();
 
@@ -21,11 +84,27 @@ class Shader final {
     Shader(Shader&&) = default;
     Shader& operator=(Shader&&) = default;
 
-    // Sets uniform with name to value of mat.
+    // Makes the program current, for drawing and setting uniforms.
+    void use();
+
+    // Makes the declared uniform block read from the buffer range bound to the binding point.
+    // Throws if the program has no such block, or one larger than the declared size.
+    void bind_uniform_block(const UniformBlockDecl& block, unsigned int binding);
+
+    // Returns a handle to the declared uniform.
+    // Throws if the program has no active uniform of that name and type.
+    template <typename T> UniformHandle<T> uniform(const UniformDecl<T>& decl) const {
+        return UniformHandle<T>(uniform_location(decl.name, UniformType<T>::GL_TYPE));
+    }
+
+    // Sets uniform with name to value of mat, looking it up among the reflected uniforms.
+    // Prefer handles for uniforms set every frame.
     // The input matrix should be stored row-major.
     void set_uniform(std::string_view name, const Matrix4& mat);
 
   private:
+    int uniform_location(std::string_view name, unsigned int gl_type) const;
+
     class Impl;
     struct ImplDeleter {
         void operator()(Impl*) const;
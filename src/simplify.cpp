@@ -0,0 +1,370 @@
+#include "simplify.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+// Boundary planes weigh more than surface planes, so that open borders keep their outline
+const double BORDER_WEIGHT = 10;
+
+// Levels dropping less than this fraction of the previous level's triangles are not worth keeping
+const double MIN_LEVEL_REDUCTION = 0.1;
+
+const std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+using Vec3 = std::array<double, 3>;
+
+Vec3 sub(const Vec3& a, const Vec3& b) { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+
+Vec3 cross(const Vec3& a, const Vec3& b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+double dot(const Vec3& a, const Vec3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+double length(const Vec3& a) { return std::sqrt(dot(a, a)); }
+
+// Sum of squared distances to a set of weighted planes, as p^T A p + 2 b^T p + c
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+
+    // Adds the plane n.p + d = 0, where n is a unit vector
+    void add_plane(const Vec3& n, double d, double weight) {
+        a00 += weight * n[0] * n[0];
+        a01 += weight * n[0] * n[1];
+        a02 += weight * n[0] * n[2];
+        a11 += weight * n[1] * n[1];
+        a12 += weight * n[1] * n[2];
+        a22 += weight * n[2] * n[2];
+        b0 += weight * n[0] * d;
+        b1 += weight * n[1] * d;
+        b2 += weight * n[2] * d;
+        c += weight * d * d;
+    }
+
+    void add(const Quadric& other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a11 += other.a11;
+        a12 += other.a12;
+        a22 += other.a22;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+    }
+
+    double error(const Vec3& p) const {
+        const double x = p[0], y = p[1], z = p[2];
+        const double q = a00 * x * x + a11 * y * y + a22 * z * z +
+                         2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                         2 * (b0 * x + b1 * y + b2 * z) + c;
+        // Rounding can make the error of a vertex on all of its planes slightly negative
+        return std::fabs(q);
+    }
+};
+
+enum class VertexKind : unsigned char {
+    // Interior vertex, may collapse along any edge
+    Manifold,
+    // On an open boundary, may only collapse along the boundary
+    Border,
+    // Non-manifold, never collapsed
+    Locked,
+};
+
+// Undirected edge of a triangle, keyed by its sorted endpoints
+struct Edge {
+    std::uint64_t key;
+    std::uint32_t triangle;
+};
+
+struct Collapse {
+    std::uint32_t from;
+    std::uint32_t to;
+    double cost;
+};
+
+class Simplifier {
+  public:
+    Simplifier(const float* positions, size_t vertex_count,
+               const std::vector<std::uint32_t>& indices);
+
+    // Collapses edges until at most target triangles are left, or until no edge can be collapsed
+    void simplify(std::vector<std::uint32_t>& indices, size_t target);
+
+  private:
+    Vec3 position(std::uint32_t v) const {
+        return {positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]};
+    }
+
+    // Normal scaled by twice the area
+    Vec3 normal(const std::uint32_t* triangle) const {
+        const Vec3 p0 = position(triangle[0]);
+        return cross(sub(position(triangle[1]), p0), sub(position(triangle[2]), p0));
+    }
+
+    std::vector<Edge> sorted_edges(const std::vector<std::uint32_t>& indices) const;
+    void classify(const std::vector<Edge>& edges);
+
+    // Returns true if moving from onto to turns any triangle around from over
+    bool flips(std::uint32_t from, std::uint32_t to, const std::vector<std::uint32_t>& indices,
+               const std::vector<std::uint32_t>& offsets,
+               const std::vector<std::uint32_t>& adjacency) const;
+
+    const float* positions;
+    size_t vertex_count;
+    std::vector<Quadric> quadrics;
+    std::vector<VertexKind> kinds;
+};
+
+Simplifier::Simplifier(const float* positions, size_t vertex_count,
+                       const std::vector<std::uint32_t>& indices)
+    : positions(positions), vertex_count(vertex_count), quadrics(vertex_count),
+      kinds(vertex_count, VertexKind::Manifold) {
+    // Plane of each triangle, weighted by its area
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const Vec3 n = normal(&indices[i]);
+        const double area = length(n);
+        if (area == 0) {
+            continue;
+        }
+        const Vec3 unit{n[0] / area, n[1] / area, n[2] / area};
+        const double d = -dot(unit, position(indices[i]));
+        for (int j = 0; j < 3; j++) {
+            quadrics[indices[i + j]].add_plane(unit, d, area / 2);
+        }
+    }
+
+    // Plane through each boundary edge, perpendicular to its triangle
+    const std::vector<Edge> edges = sorted_edges(indices);
+    for (size_t i = 0; i < edges.size(); i++) {
+        const bool single = (i == 0 || edges[i - 1].key != edges[i].key) &&
+                            (i + 1 == edges.size() || edges[i + 1].key != edges[i].key);
+        if (single == false) {
+            continue;
+        }
+        const std::uint32_t a = static_cast<std::uint32_t>(edges[i].key >> 32);
+        const std::uint32_t b = static_cast<std::uint32_t>(edges[i].key);
+        const Vec3 edge = sub(position(b), position(a));
+        const Vec3 n = cross(edge, normal(&indices[3 * edges[i].triangle]));
+        const double n_length = length(n);
+        if (n_length == 0) {
+            continue;
+        }
+        const Vec3 unit{n[0] / n_length, n[1] / n_length, n[2] / n_length};
+        const double d = -dot(unit, position(a));
+        const double weight = dot(edge, edge) * BORDER_WEIGHT;
+        quadrics[a].add_plane(unit, d, weight);
+        quadrics[b].add_plane(unit, d, weight);
+    }
+}
+
+std::vector<Edge> Simplifier::sorted_edges(const std::vector<std::uint32_t>& indices) const {
+    std::vector<Edge> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (int j = 0; j < 3; j++) {
+            const std::uint64_t a = indices[i + j];
+            const std::uint64_t b = indices[i + (j + 1) % 3];
+            edges.push_back(Edge{std::min(a, b) << 32 | std::max(a, b),
+                                 static_cast<std::uint32_t>(i / 3)});
+        }
+    }
+    std::sort(edges.begin(), edges.end(),
+              [](const Edge& lhs, const Edge& rhs) { return lhs.key < rhs.key; });
+    return edges;
+}
+
+void Simplifier::classify(const std::vector<Edge>& edges) {
+    std::vector<unsigned char> border_edges(vertex_count, 0);
+    std::vector<bool> non_manifold(vertex_count, false);
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j].key == edges[i].key) {
+            j++;
+        }
+        const std::uint32_t a = static_cast<std::uint32_t>(edges[i].key >> 32);
+        const std::uint32_t b = static_cast<std::uint32_t>(edges[i].key);
+        if (j - i == 1) {
+            border_edges[a] = static_cast<unsigned char>(std::min(border_edges[a] + 1, 3));
+            border_edges[b] = static_cast<unsigned char>(std::min(border_edges[b] + 1, 3));
+        } else if (j - i > 2) {
+            non_manifold[a] = true;
+            non_manifold[b] = true;
+        }
+        i = j;
+    }
+
+    for (size_t v = 0; v < vertex_count; v++) {
+        if (non_manifold[v] || (border_edges[v] != 0 && border_edges[v] != 2)) {
+            kinds[v] = VertexKind::Locked;
+        } else if (border_edges[v] == 2) {
+            kinds[v] = VertexKind::Border;
+        } else {
+            kinds[v] = VertexKind::Manifold;
+        }
+    }
+}
+
+bool Simplifier::flips(std::uint32_t from, std::uint32_t to,
+                       const std::vector<std::uint32_t>& indices,
+                       const std::vector<std::uint32_t>& offsets,
+                       const std::vector<std::uint32_t>& adjacency) const {
+    const Vec3 target = position(to);
+    for (std::uint32_t k = offsets[from]; k < offsets[from + 1]; k++) {
+        const std::uint32_t* triangle = &indices[3 * adjacency[k]];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+            // Collapses into a degenerate triangle, which is dropped
+            continue;
+        }
+        Vec3 p[3];
+        for (int j = 0; j < 3; j++) {
+            p[j] = triangle[j] == from ? target : position(triangle[j]);
+        }
+        const Vec3 after = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+        if (dot(normal(triangle), after) <= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Simplifier::simplify(std::vector<std::uint32_t>& indices, size_t target) {
+    std::vector<Collapse> collapses;
+    std::vector<std::uint32_t> offsets(vertex_count + 1);
+    std::vector<std::uint32_t> adjacency;
+    std::vector<std::uint32_t> remap(vertex_count);
+    std::vector<bool> touched(vertex_count);
+
+    // Each pass collapses the cheapest edges that do not share a vertex
+    while (indices.size() / 3 > target) {
+        const std::vector<Edge> edges = sorted_edges(indices);
+        classify(edges);
+
+        collapses.clear();
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i;
+            while (j < edges.size() && edges[j].key == edges[i].key) {
+                j++;
+            }
+            const size_t count = j - i;
+            const std::uint32_t a = static_cast<std::uint32_t>(edges[i].key >> 32);
+            const std::uint32_t b = static_cast<std::uint32_t>(edges[i].key);
+            i = j;
+            if (count > 2 || a == b) {
+                continue;
+            }
+
+            Collapse best{NONE, NONE, std::numeric_limits<double>::infinity()};
+            for (const auto& [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+                const bool allowed =
+                    kinds[from] == VertexKind::Manifold ||
+                    (kinds[from] == VertexKind::Border && count == 1);
+                if (allowed == false) {
+                    continue;
+                }
+                Quadric merged = quadrics[from];
+                merged.add(quadrics[to]);
+                const double cost = merged.error(position(to));
+                if (cost < best.cost) {
+                    best = Collapse{from, to, cost};
+                }
+            }
+            if (best.from != NONE) {
+                collapses.push_back(best);
+            }
+        }
+        if (collapses.empty()) {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+        // Triangles around each vertex, for the flip test
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const std::uint32_t v : indices) {
+            offsets[v + 1]++;
+        }
+        for (size_t v = 0; v < vertex_count; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        adjacency.resize(indices.size());
+        {
+            std::vector<std::uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++) {
+                adjacency[cursor[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+            }
+        }
+
+        // Each collapse removes about two triangles
+        const size_t goal = std::max<size_t>((indices.size() / 3 - target) / 2, 1);
+        std::fill(remap.begin(), remap.end(), NONE);
+        std::fill(touched.begin(), touched.end(), false);
+        size_t performed = 0;
+        for (const auto& collapse : collapses) {
+            if (performed >= goal) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to] ||
+                flips(collapse.from, collapse.to, indices, offsets, adjacency)) {
+                continue;
+            }
+            remap[collapse.from] = collapse.to;
+            touched[collapse.from] = true;
+            touched[collapse.to] = true;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            performed++;
+        }
+        if (performed == 0) {
+            break;
+        }
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t kept = 0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            std::uint32_t triangle[3];
+            for (int j = 0; j < 3; j++) {
+                const std::uint32_t v = indices[i + j];
+                triangle[j] = remap[v] == NONE ? v : remap[v];
+            }
+            if (triangle[0] == triangle[1] || triangle[1] == triangle[2] ||
+                triangle[0] == triangle[2]) {
+                continue;
+            }
+            std::copy(triangle, triangle + 3, indices.begin() + kept);
+            kept += 3;
+        }
+        indices.resize(kept);
+    }
+}
+} // namespace
+
+std::vector<std::vector<std::uint32_t>> simplify_chain(const std::uint32_t* indices,
+                                                       size_t index_count, const float* positions,
+                                                       size_t vertex_count,
+                                                       const std::vector<float>& ratios) {
+    std::vector<std::uint32_t> current(indices, indices + index_count - index_count % 3);
+    Simplifier simplifier{positions, vertex_count, current};
+
+    const size_t triangle_count = current.size() / 3;
+    size_t previous = triangle_count;
+    std::vector<std::vector<std::uint32_t>> levels;
+    for (const float ratio : ratios) {
+        simplifier.simplify(current, static_cast<size_t>(static_cast<double>(triangle_count) *
+                                                         static_cast<double>(ratio)));
+        const size_t count = current.size() / 3;
+        if (static_cast<double>(count) <=
+            static_cast<double>(previous) * (1 - MIN_LEVEL_REDUCTION)) {
+            levels.push_back(current);
+            previous = count;
+        }
+    }
+    return levels;
+}
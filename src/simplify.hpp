@@ -0,0 +1,25 @@
+#ifndef SIMPLIFY_HPP_
+#define SIMPLIFY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::size_t;
+
+// Builds a chain of successively coarser versions of a triangle list with quadric error metric
+// edge collapses (Garland and Heckbert 1997).
+//
+// Each entry of ratios is a target fraction of the input triangle count, in decreasing order.
+// Vertices are collapsed onto one of their neighbors rather than moved, so every level indexes
+// the input vertices.  Boundaries are preserved and non-manifold vertices are never collapsed, so
+// a level may stay above its target; levels that would not be smaller than the previous one are
+// left out.
+//
+// Positions holds three floats per vertex.
+std::vector<std::vector<std::uint32_t>> simplify_chain(const std::uint32_t* indices,
+                                                       size_t index_count, const float* positions,
+                                                       size_t vertex_count,
+                                                       const std::vector<float>& ratios);
+
+#endif
@@ -0,0 +1,198 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+// Invocations of a parallel_for, shared with the tasks queued to help with them
+struct ParallelFor {
+    ParallelFor(const std::function<void(size_t)>& body, size_t count)
+        : body(body), count(count), next(0), errors(count), mutex(), cond(), done(0) {}
+
+    // Runs invocations until none is left to claim.  The body is only touched by invocations
+    // claimed before all are done, while the caller still waits.
+    void run() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                body(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+            std::lock_guard lock{mutex};
+            if (++done == count) {
+                cond.notify_all();
+            }
+        }
+    }
+
+    const std::function<void(size_t)>& body;
+    const size_t count;
+    std::atomic<size_t> next;
+    std::vector<std::exception_ptr> errors;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t done;
+};
+
+void rethrow_first(const std::vector<std::exception_ptr>& errors) {
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void serial_for(size_t count, const std::function<void(size_t)>& body) {
+    std::vector<std::exception_ptr> errors(count);
+    for (size_t i = 0; i < count; i++) {
+        try {
+            body(i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    }
+    rethrow_first(errors);
+}
+} // namespace
+
+struct ThreadPool::Impl {
+    Impl(size_t thread_count);
+    ~Impl();
+
+    void enqueue(std::function<void()> task, TaskPriority priority);
+    void work();
+
+    // Runs body(i) for every i in [0, count) on the calling thread and the idle workers
+    void share(size_t count, const std::function<void(size_t)>& body);
+
+    // Pool of the worker running on this thread, if any
+    static thread_local Impl* current;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> tasks;
+    bool stopping;
+
+    // Declared last so that the workers start after the other members are constructed
+    std::vector<std::thread> workers;
+};
+
+thread_local ThreadPool::Impl* ThreadPool::Impl::current = nullptr;
+
+ThreadPool::ThreadPool(size_t thread_count) : impl(std::make_unique<Impl>(thread_count)) {}
+ThreadPool::Impl::Impl(size_t thread_count) : mutex(), cond(), tasks(), stopping(false) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; i++) {
+        workers.emplace_back([this]() { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() = default;
+ThreadPool::Impl::~Impl() {
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+        tasks.clear();
+    }
+    cond.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task, TaskPriority priority) {
+    impl->enqueue(std::move(task), priority);
+}
+void ThreadPool::Impl::enqueue(std::function<void()> task, TaskPriority priority) {
+    {
+        std::lock_guard lock{mutex};
+        if (priority == TaskPriority::Urgent) {
+            tasks.push_front(std::move(task));
+        } else {
+            tasks.push_back(std::move(task));
+        }
+    }
+    cond.notify_one();
+}
+
+void ThreadPool::Impl::work() {
+    current = this;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{mutex};
+            cond.wait(lock, [this]() { return stopping || tasks.empty() == false; });
+            if (stopping) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+size_t ThreadPool::default_thread_count() {
+    const size_t hardware = std::thread::hardware_concurrency();
+    return hardware > 1 ? hardware - 1 : 1;
+}
+
+bool ThreadPool::on_worker() { return Impl::current != nullptr; }
+
+void ThreadPool::Impl::share(size_t count, const std::function<void(size_t)>& body) {
+    const auto state = std::make_shared<ParallelFor>(body, count);
+    // Helpers go ahead of the queue, since they only speed up work that is already running.
+    // Those picked after the caller claimed everything return at once.
+    for (size_t i = 1; i < count; i++) {
+        enqueue([state]() { state->run(); }, TaskPriority::Urgent);
+    }
+    state->run();
+    std::unique_lock lock{state->mutex};
+    state->cond.wait(lock, [&]() { return state->done == count; });
+    rethrow_first(state->errors);
+}
+
+void parallel_for(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    // Nested in a task, the other workers are busy as well, so no threads are added to them
+    if (ThreadPool::Impl::current != nullptr) {
+        ThreadPool::Impl::current->share(count, body);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(count);
+    const auto run = [&](size_t i) {
+        try {
+            body(i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(count - 1);
+    for (size_t i = 1; i < count; i++) {
+        threads.emplace_back(run, i);
+    }
+    run(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    rethrow_first(errors);
+}
+
+void parallel_for(ThreadPool& pool, size_t count, const std::function<void(size_t)>& body) {
+    if (count <= 1) {
+        serial_for(count, body);
+        return;
+    }
+    pool.impl->share(count, body);
+}
@@ -0,0 +1,77 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+using std::size_t;
+
+// Order in which queued tasks are picked by the workers.
+enum class TaskPriority {
+    // Queued behind all other tasks
+    Normal,
+    // Queued ahead of all other tasks, so that the latest urgent task is picked first
+    Urgent,
+};
+
+// Fixed-size pool of worker threads running queued tasks in FIFO order, unless queued as urgent.
+//
+// Tasks still queued when the pool is destructed are dropped, which leaves their futures with a
+// broken promise.  Tasks already running are waited for.
+class ThreadPool final {
+  public:
+    explicit ThreadPool(size_t thread_count = default_thread_count());
+    ~ThreadPool();
+
+    // Prevent copy and move
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    // Queues the callable to be run on one of the workers.
+    // Exceptions thrown by the callable are rethrown from the returned future.
+    template <class F>
+    std::future<std::invoke_result_t<F>> submit(F&& func,
+                                                TaskPriority priority = TaskPriority::Normal) {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+        auto future = task->get_future();
+        enqueue([task]() { (*task)(); }, priority);
+        return future;
+    }
+
+    // Number of hardware threads minus one for the main thread, but at least one.
+    static size_t default_thread_count();
+
+    // Returns true if called from a worker of any pool.
+    static bool on_worker();
+
+  private:
+    void enqueue(std::function<void()> task, TaskPriority priority);
+
+    friend void parallel_for(size_t count, const std::function<void(size_t)>& body);
+    friend void parallel_for(ThreadPool& pool, size_t count,
+                             const std::function<void(size_t)>& body);
+
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Runs body(i) for every i in [0, count), each on its own thread, and waits for all of them.
+// The calling thread runs body(0) itself.  On a pool worker they are shared with the idle workers
+// of its pool instead, as by the overload below, so that loops nested in tasks never run more
+// threads than the pool has.
+// If any invocation throws, the first exception is rethrown after all threads are joined.
+void parallel_for(size_t count, const std::function<void(size_t)>& body);
+
+// Runs body(i) for every i in [0, count) on the workers of the pool and the calling thread, and
+// waits for all of them.  Invocations that no worker picked up yet are run by the calling thread,
+// so that it never waits behind other tasks.
+void parallel_for(ThreadPool& pool, size_t count, const std::function<void(size_t)>& body);
+
+#endif
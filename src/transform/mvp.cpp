@@ -21,6 +21,7 @@ class Mvp::Impl {
     void set_viewport_size(int width, int height);
     void set_project_mode(Projection::Mode mode);
     void debug_print() const;
+    bool take_dirty();
 
     void update_translation(Vector3 delta);
     void update_rotation(Vector3 delta);
@@ -42,6 +43,9 @@ class Mvp::Impl {
     mutable std::optional<Matrix4> cached_vp;
     mutable std::optional<Matrix4> cached_trs;
 
+    // Whether the matrices changed since the last call to take_dirty
+    bool dirty;
+
     void inval_vp();
     void inval_trs();
 };
@@ -57,9 +61,12 @@ Mvp::Impl::Impl(int width, int height)
                .with_fovy(80)
                .with_aspect(static_cast<float>(width) / static_cast<float>(height))
                .build()),
-      viewer({0.0, 0.0, 2.0}, {0.0, 0.0, 0.0}, {0.0, 1.0, 0.0}), trans({0, 0, 0}),
+      viewer(DEFAULT_EYEPOS, DEFAULT_CENTER, {0.0, 1.0, 0.0}), trans({0, 0, 0}),
       rotate({0, 0, 0}), scale({1, 1, 1}), cached(std::nullopt), cached_vp(std::nullopt),
-      cached_trs(std::nullopt) {}
+      cached_trs(std::nullopt), dirty(true) {}
+
+const Vector3 Mvp::DEFAULT_EYEPOS{0.0, 0.0, 2.0};
+const Vector3 Mvp::DEFAULT_CENTER{0.0, 0.0, 0.0};
 
 Mvp::Mvp(int width, int height) : impl(std::make_unique<Impl>(width, height)) {}
 Mvp::~Mvp() = default;
@@ -87,6 +94,9 @@ void Mvp::set_project_mode(ProjectMode mode) {
     impl->set_project_mode(pmode);
 }
 
+bool Mvp::take_dirty() { return impl->take_dirty(); }
+bool Mvp::Impl::take_dirty() { return std::exchange(dirty, false); }
+
 void Mvp::debug_print() const { impl->debug_print(); }
 void Mvp::Impl::debug_print() const {
     std::array<std::pair<const char*, const Transform&>, 5> pairs{{{"Viewing", viewer},
@@ -159,5 +169,11 @@ Matrix4 Mvp::Impl::view_project_matrix() const {
     return *cached;
 }
 
-void Mvp::Impl::inval_vp() { cached = cached_vp = std::nullopt; }
-void Mvp::Impl::inval_trs() { cached = cached_trs = std::nullopt; }
+void Mvp::Impl::inval_vp() {
+    cached = cached_vp = std::nullopt;
+    dirty = true;
+}
+void Mvp::Impl::inval_trs() {
+    cached = cached_trs = std::nullopt;
+    dirty = true;
+}
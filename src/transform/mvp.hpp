@@ -10,6 +10,10 @@ class Mvp : public StagedTransform {
   public:
     explicit Mvp(int width, int height);
     ~Mvp();
+
+    // Initial eye position and viewing center of the camera
+    static const Vector3 DEFAULT_EYEPOS;
+    static const Vector3 DEFAULT_CENTER;
     virtual Matrix4 matrix() const override;
     virtual Matrix4 model_matrix() const override;
     virtual Matrix4 view_project_matrix() const override;
@@ -27,6 +31,9 @@ class Mvp : public StagedTransform {
     // Updates the projection mode.
     void set_project_mode(ProjectMode mode);
 
+    // Returns true if any of the matrices changed since the last call.
+    bool take_dirty();
+
     // Prints the underlying matrices.
     void debug_print() const;
 
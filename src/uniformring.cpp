@@ -0,0 +1,146 @@
+#include "uniformring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "glstate.hpp"
+
+namespace {
+// Regions start at this size and double when a frame outgrows them
+const size_t MIN_REGION_BYTES = size_t{64} << 10;
+
+// Fences are waited on in slices of this length until they signal
+const GLuint64 WAIT_SLICE_NANOSECONDS = 1000000000;
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+struct UniformRing::Impl {
+    GLuint buffer;
+    // Offset alignment of ranges bound to uniform blocks
+    size_t alignment;
+    size_t region_bytes;
+    size_t frame;
+    std::array<GLsync, FRAMES_IN_FLIGHT> fences;
+    std::vector<unsigned char> staging;
+
+    Impl();
+    ~Impl();
+    void allocate(size_t bytes);
+    void wait(size_t region);
+    void upload();
+};
+
+UniformRing::UniformRing() : impl(std::make_unique<Impl>()) {}
+UniformRing::~UniformRing() = default;
+
+UniformRing::Impl::Impl()
+    : buffer(0), alignment(256), region_bytes(0), frame(0), fences(), staging() {
+    GLint value = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+    alignment = value > 0 ? static_cast<size_t>(value) : alignment;
+    glGenBuffers(1, &buffer);
+    allocate(MIN_REGION_BYTES);
+}
+
+UniformRing::Impl::~Impl() {
+    for (GLsync fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+        }
+    }
+    delete_buffer(buffer);
+}
+
+void UniformRing::Impl::allocate(size_t bytes) {
+    // Reallocating orphans the old storage, so draws still reading it need no fences
+    for (GLsync& fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    region_bytes = align_up(bytes, alignment);
+    bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(FRAMES_IN_FLIGHT * region_bytes),
+                 nullptr, GL_STREAM_DRAW);
+}
+
+void UniformRing::Impl::wait(size_t region) {
+    GLsync& fence = fences[region];
+    if (fence == nullptr) {
+        return;
+    }
+    for (;;) {
+        const GLenum result =
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_SLICE_NANOSECONDS);
+        if (result != GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void UniformRing::begin_frame() {
+    impl->frame = (impl->frame + 1) % FRAMES_IN_FLIGHT;
+    impl->wait(impl->frame);
+    impl->staging.clear();
+}
+
+size_t UniformRing::push(const void* data, size_t size) {
+    std::vector<unsigned char>& staging = impl->staging;
+    const size_t offset = align_up(staging.size(), impl->alignment);
+    staging.resize(offset + size);
+    std::memcpy(staging.data() + offset, data, size);
+    return offset;
+}
+
+void UniformRing::upload() { impl->upload(); }
+void UniformRing::Impl::upload() {
+    if (staging.empty()) {
+        return;
+    }
+    if (staging.size() > region_bytes) {
+        size_t bytes = region_bytes;
+        while (bytes < staging.size()) {
+            bytes *= 2;
+        }
+        allocate(bytes);
+    }
+
+    // The fence waited on in begin_frame guarantees that no draw reads the region anymore
+    const auto offset = static_cast<GLintptr>(frame * region_bytes);
+    const auto size = static_cast<GLsizeiptr>(staging.size());
+    bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                        GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped != nullptr) {
+        std::memcpy(mapped, staging.data(), staging.size());
+        if (glUnmapBuffer(GL_UNIFORM_BUFFER) == GL_TRUE) {
+            return;
+        }
+    }
+    // Mapping failed, or the contents were lost while mapped
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, staging.data());
+}
+
+void UniformRing::bind(unsigned int binding, size_t offset, size_t size) const {
+    bind_buffer_range(GL_UNIFORM_BUFFER, binding, impl->buffer,
+                      impl->frame * impl->region_bytes + offset, size);
+}
+
+void UniformRing::end_frame() {
+    GLsync& fence = impl->fences[impl->frame];
+    if (fence != nullptr) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,48 @@
+#ifndef UNIFORMRING_HPP_
+#define UNIFORMRING_HPP_
+
+#include <cstddef>
+#include <memory>
+
+using std::size_t;
+
+// Uniform buffer split into one region per frame in flight, holding the std140 constants of the
+// frames.
+//
+// Constants are gathered in memory while a frame is recorded, and written to the region of the
+// frame with one mapping.  The region is reused three frames later, after waiting on the fence
+// placed behind the draws reading it, so writes never stall on draws still in flight.
+class UniformRing final {
+  public:
+    static const size_t FRAMES_IN_FLIGHT = 3;
+
+    UniformRing();
+    ~UniformRing();
+
+    // Prevent copy and move
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+    UniformRing(UniformRing&&) = delete;
+    UniformRing& operator=(UniformRing&&) = delete;
+
+    // Starts the next frame, waiting until the GPU has finished reading its region.
+    void begin_frame();
+
+    // Appends constants to the frame, returning their offset within it, aligned for binding.
+    size_t push(const void* data, size_t size);
+
+    // Writes the constants of the frame to its region, growing the buffer if they do not fit.
+    void upload();
+
+    // Binds size bytes at the offset within the frame to the uniform block binding point.
+    void bind(unsigned int binding, size_t offset, size_t size) const;
+
+    // Fences the region of the frame, after the draws reading it were issued.
+    void end_frame();
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
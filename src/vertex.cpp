@@ -0,0 +1,120 @@
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <glad/glad.h>
+
+namespace {
+struct FloatVertex {
+    GLfloat position[3];
+    GLfloat color[3];
+};
+
+struct CompactVertex {
+    GLshort position[4];
+    GLubyte color[4];
+};
+
+static_assert(sizeof(FloatVertex) == 24, "unexpected padding in FloatVertex");
+static_assert(sizeof(CompactVertex) == 12, "unexpected padding in CompactVertex");
+
+GLshort to_snorm16(float value) {
+    return static_cast<GLshort>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+GLubyte to_unorm8(float value) {
+    return static_cast<GLubyte>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+const void* offset(size_t bytes) { return reinterpret_cast<const void*>(bytes); }
+} // namespace
+
+size_t vertex_size(VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Float:
+        return sizeof(FloatVertex);
+    case VertexFormat::Compact:
+        return sizeof(CompactVertex);
+    }
+    return 0;
+}
+
+void pack_vertex(VertexFormat format, unsigned char* dst, const float* position,
+                 const float* color) {
+    switch (format) {
+    case VertexFormat::Float: {
+        FloatVertex vertex{{position[0], position[1], position[2]}, {color[0], color[1], color[2]}};
+        std::memcpy(dst, &vertex, sizeof(vertex));
+    } break;
+    case VertexFormat::Compact: {
+        CompactVertex vertex{
+            {to_snorm16(position[0]), to_snorm16(position[1]), to_snorm16(position[2]), 0},
+            {to_unorm8(color[0]), to_unorm8(color[1]), to_unorm8(color[2]), 255}};
+        std::memcpy(dst, &vertex, sizeof(vertex));
+    } break;
+    }
+}
+
+void unpack_position(VertexFormat format, const unsigned char* src, float* position) {
+    switch (format) {
+    case VertexFormat::Float: {
+        FloatVertex vertex;
+        std::memcpy(&vertex, src, sizeof(vertex));
+        std::copy(vertex.position, vertex.position + 3, position);
+    } break;
+    case VertexFormat::Compact: {
+        CompactVertex vertex;
+        std::memcpy(&vertex, src, sizeof(vertex));
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis] = std::max(vertex.position[axis] / 32767.0f, -1.0f);
+        }
+    } break;
+    }
+}
+
+void set_vertex_attributes(VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Float:
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FloatVertex),
+                              offset(offsetof(FloatVertex, position)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(FloatVertex),
+                              offset(offsetof(FloatVertex, color)));
+        break;
+    case VertexFormat::Compact:
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(CompactVertex),
+                              offset(offsetof(CompactVertex, position)));
+        glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex),
+                              offset(offsetof(CompactVertex, color)));
+        break;
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+}
+
+void set_instance_attributes() {
+    for (GLuint column = 0; column < 4; column++) {
+        const GLuint attribute = INSTANCE_MATRIX_ATTRIBUTE + column;
+        glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                              offset(4 * column * sizeof(GLfloat)));
+        glVertexAttribDivisor(attribute, 1);
+        glEnableVertexAttribArray(attribute);
+    }
+}
+
+void disable_instance_attributes() {
+    for (GLuint column = 0; column < 4; column++) {
+        glDisableVertexAttribArray(INSTANCE_MATRIX_ATTRIBUTE + column);
+    }
+    // The generic value is undefined after a draw that read the attribute from an array
+    reset_instance_matrix();
+}
+
+void reset_instance_matrix() {
+    for (GLuint column = 0; column < 4; column++) {
+        const auto unit = [&](GLuint row) { return row == column ? 1.0f : 0.0f; };
+        glVertexAttrib4f(INSTANCE_MATRIX_ATTRIBUTE + column, unit(0), unit(1), unit(2), unit(3));
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef VERTEX_HPP_
+#define VERTEX_HPP_
+
+#include <cstddef>
+
+using std::size_t;
+
+// Layout of interleaved vertex buffers holding a position and a color per vertex.
+enum class VertexFormat {
+    // 3 x 32-bit float position, 3 x 32-bit float color (24 bytes)
+    Float,
+    // 3 x 16-bit SNORM position padded to 8 bytes, 4 x 8-bit UNORM color (12 bytes).
+    // Positions must lie within [-1, 1].
+    Compact,
+};
+
+// Returns the size of one vertex in bytes.
+size_t vertex_size(VertexFormat format);
+
+// Writes one vertex to dst, which must have room for vertex_size(format) bytes.
+// Both position and color point to three floats.
+void pack_vertex(VertexFormat format, unsigned char* dst, const float* position,
+                 const float* color);
+
+// Reads the position of one vertex written by pack_vertex into three floats.
+void unpack_position(VertexFormat format, const unsigned char* src, float* position);
+
+// Points attribute 0 (position) and 1 (color) of the bound vertex array object into the buffer
+// bound to GL_ARRAY_BUFFER, and enables them.
+void set_vertex_attributes(VertexFormat format);
+
+// First of the four attributes holding the columns of the per-instance model matrix.
+const unsigned int INSTANCE_MATRIX_ATTRIBUTE = 2;
+
+// Points the instance matrix attributes of the bound vertex array object into the buffer bound to
+// GL_ARRAY_BUFFER, which holds a column-major 4x4 float matrix per instance, and enables them
+// with a divisor of one.
+void set_instance_attributes();
+
+// Disables the instance matrix attributes of the bound vertex array object, and resets their
+// generic value with reset_instance_matrix.
+void disable_instance_attributes();
+
+// Sets the generic value of the instance matrix attributes, which draws without instances read, to
+// the identity.
+void reset_instance_matrix();
+
+#endif
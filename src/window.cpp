@@ -12,6 +12,7 @@
 #include <optional>
 #include <stdexcept>
 #include <unordered_map>
+#include <utility>
 
 Glfw::Glfw() {
     int res = glfwInit();
@@ -48,16 +49,22 @@ struct PairHash {
 // Convert raw GLFW_KEY_* to safe types
 std::optional<Key> int_to_key(int raw);
 std::optional<KeyAction> int_to_action(int raw);
+
+// Longest wait for events between idle iterations of an on-demand loop
+const double IDLE_WAIT_SECONDS = 0.25;
+// Wait between frames of an on-demand loop while background work changes them
+const double PENDING_WAIT_SECONDS = 1.0 / 30;
 } // namespace
 
 struct Window::Impl {
-    Impl(GLFWwindow* window) : window(window), key_callbacks(), vsync(true) {
+    Impl(GLFWwindow* window) : window(window), key_callbacks(), vsync(true), dirty(true) {
         glfwSetWindowUserPointer(window, this);
         glfwSetKeyCallback(window, key_callback);
         glfwSetScrollCallback(window, scroll_callback);
         glfwSetMouseButtonCallback(window, mouse_button_callback);
         glfwSetCursorPosCallback(window, cursor_pos_callback);
         glfwSetFramebufferSizeCallback(window, fb_size_callback);
+        glfwSetWindowRefreshCallback(window, refresh_callback);
     }
 
     static void key_callback(GLFWwindow* window, int raw_key, int scancode, int raw_action,
@@ -106,11 +113,17 @@ struct Window::Impl {
     static void fb_size_callback(GLFWwindow* window, int width, int height) {
         glViewport(0, 0, width, height);
         auto impl = static_cast<Window::Impl*>(glfwGetWindowUserPointer(window));
+        impl->dirty = true;
         if (auto callback = impl->_fb_size_callback) {
             (*callback)(width, height);
         }
     }
 
+    static void refresh_callback(GLFWwindow* window) {
+        auto impl = static_cast<Window::Impl*>(glfwGetWindowUserPointer(window));
+        impl->dirty = true;
+    }
+
     std::unique_ptr<GLFWwindow, GlfwWindowDeleter> window;
 
     std::optional<KeyCallback> _key_callback;
@@ -122,6 +135,9 @@ struct Window::Impl {
     std::unordered_map<std::pair<Key, KeyAction>, KeyCallback, PairHash> key_callbacks;
 
     bool vsync;
+
+    // Whether the contents need to be drawn again, for on-demand loops
+    bool dirty;
 };
 
 Window::Window(const Glfw& glfw, std::string title, int width, int height) {
@@ -169,6 +185,29 @@ void Window::loop(std::function<void()> body) const {
     }
 }
 
+void Window::loop_on_demand(std::function<FrameStatus()> body) const {
+    auto window = impl->window.get();
+    glfwMakeContextCurrent(window);
+
+    while (glfwWindowShouldClose(window) == GLFW_FALSE) {
+        switch (body()) {
+        case FrameStatus::Idle:
+            glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
+            break;
+        case FrameStatus::Drawn:
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            break;
+        case FrameStatus::Pending:
+            glfwSwapBuffers(window);
+            glfwWaitEventsTimeout(PENDING_WAIT_SECONDS);
+            break;
+        }
+    }
+}
+
+bool Window::take_dirty() { return std::exchange(impl->dirty, false); }
+
 void Window::make_current() const {
     auto window = impl->window.get();
     glfwMakeContextCurrent(window);
@@ -5,6 +5,8 @@
 #include <memory>
 #include <string>
 
+#include "glcontext.hpp"
+
 // Wrapper class for GLFW initialization / termination.
 //
 // Existence of an instance of this guarantees that the GLFW library has been initialized.
@@ -34,8 +36,18 @@ using MouseButtonCallback = std::function<void(KeyAction)>;
 using CursorPosCallback = std::function<void(float, float)>;
 using FbSizeCallback = std::function<void(int, int)>;
 
+// What the body of an on-demand main loop did in one iteration.
+enum class FrameStatus {
+    // Nothing changed, so no frame was drawn
+    Idle,
+    // A frame was drawn
+    Drawn,
+    // A frame was drawn, and background work will change the next one without any event
+    Pending,
+};
+
 // Wrapper class for GLFW windows.
-class Window final {
+class Window final : public GlContext {
   public:
     // Constructs a window and makes its associated context current.
     Window(const Glfw& glfw, std::string title, int width = DEFAULT_WIDTH,
@@ -54,8 +66,18 @@ class Window final {
     // Runs the main loop until the close flag of the window is set.
     void loop(std::function<void()> body) const;
 
+    // Runs the main loop until the close flag of the window is set, presenting only the frames the
+    // body draws.
+    // After an idle iteration, blocks until an event arrives or a short timeout passes, so that
+    // work the body polls is still picked up.  After a pending one, waits at most a frame at a
+    // reduced rate.
+    void loop_on_demand(std::function<FrameStatus()> body) const;
+
+    // Returns true if the contents of the window were damaged or resized since the last call.
+    bool take_dirty();
+
     // Makes the context of this window the current context
-    void make_current() const;
+    virtual void make_current() const override;
 
     // Sets callbacks.
     // Must not be called while `loop` is running.
@@ -0,0 +1,36 @@
+#ifndef CHECK_HPP_
+#define CHECK_HPP_
+
+#include <iostream>
+
+// Number of failed checks, which main exits with
+inline int check_failures = 0;
+
+// Reports the condition if it does not hold, without stopping the test
+#define CHECK(condition)                                                                          \
+    do {                                                                                          \
+        if (!(condition)) {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Check failed: " #condition "\n";       \
+            check_failures++;                                                                     \
+        }                                                                                         \
+    } while (false)
+
+// Reports the statement if it does not throw a std::exception
+#define CHECK_THROWS(statement)                                                                   \
+    do {                                                                                          \
+        bool thrown = false;                                                                      \
+        try {                                                                                     \
+            statement;                                                                            \
+        } catch (const std::exception&) {                                                         \
+            thrown = true;                                                                        \
+        }                                                                                         \
+        if (thrown == false) {                                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Did not throw: " #statement "\n";      \
+            check_failures++;                                                                     \
+        }                                                                                         \
+    } while (false)
+
+void test_objreader();
+void test_occlusion();
+
+#endif
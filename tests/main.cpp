@@ -0,0 +1,12 @@
+#include "check.hpp"
+
+// Tests of the parts of the viewer that run on the CPU, without a GL context
+int main() {
+    test_objreader();
+    test_occlusion();
+    if (check_failures > 0) {
+        std::cerr << check_failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "objreader.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Writes the contents to a file in the temporary directory and returns its path
+std::string write_obj(const std::string& name, const std::string& contents) {
+    const fs::path path = fs::temp_directory_path() / ("objreader_test_" + name + ".obj");
+    std::ofstream(path, std::ios::binary) << contents;
+    return path.string();
+}
+
+const char* const SQUARE = "v 0 0 0\n"
+                           "v 1 0 0\n"
+                           "v 1 1 0\n"
+                           "v 0 1 0\n";
+
+void test_faces() {
+    const ObjData obj = read_obj(write_obj("quad", std::string(SQUARE) + "f 1 2 3 4\n"));
+    CHECK(obj.positions.size() == 12);
+    CHECK(obj.positions[6] == 1.0f && obj.positions[7] == 1.0f);
+    // Quads are triangulated as fans
+    CHECK((obj.indices == std::vector<std::uint32_t>{0, 1, 2, 0, 2, 3}));
+    CHECK(obj.shapes.size() == 1);
+
+    // Negative indices count back from the last vertex, and texture and normal indices are skipped
+    const ObjData relative =
+        read_obj(write_obj("relative", std::string(SQUARE) + "f -4/1/1 -3/2/2 -2//3\n"));
+    CHECK((relative.indices == std::vector<std::uint32_t>{0, 1, 2}));
+}
+
+void test_colors() {
+    const ObjData obj = read_obj(write_obj("colors", "v 0 0 0 1 0.5 0\n"
+                                                     "v 1 0 0\n"
+                                                     "v 0 1.5e1 -2\n"
+                                                     "f 1 2 3\n"));
+    CHECK(obj.colors.size() == 9);
+    CHECK(obj.colors[0] == 1.0f && obj.colors[1] == 0.5f && obj.colors[2] == 0.0f);
+    // Vertices without colors are white
+    CHECK(obj.colors[3] == 1.0f && obj.colors[4] == 1.0f && obj.colors[5] == 1.0f);
+    CHECK(obj.positions[7] == 15.0f && obj.positions[8] == -2.0f);
+}
+
+void test_shapes() {
+    const ObjData obj = read_obj(write_obj("shapes", std::string(SQUARE) + "o first\n"
+                                                                          "f 1 2 3\n"
+                                                                          "f 1 3 4\n"
+                                                                          "g empty\n"
+                                                                          "g second\n"
+                                                                          "f 4 3 2\n"));
+    // The empty group is left out
+    CHECK(obj.shapes.size() == 2);
+    CHECK(obj.shapes[0].first_index == 0 && obj.shapes[0].index_count == 6);
+    CHECK(obj.shapes[1].first_index == 6 && obj.shapes[1].index_count == 3);
+}
+
+// A file large enough to be split into chunks parsed on several threads, with faces referring to
+// vertices in earlier chunks, and both ways of reading it
+void test_chunks() {
+    const size_t count = 100000;
+    std::string contents;
+    for (size_t i = 0; i < count; i++) {
+        contents += "v " + std::to_string(i) + " 0.25 -1\n";
+    }
+    for (size_t i = 1; i < count; i++) {
+        contents += "f " + std::to_string(i) + " " + std::to_string(i + 1) + " -1\n";
+    }
+    const std::string path = write_obj("chunks", contents);
+
+    for (const FileAccess access : {FileAccess::Map, FileAccess::Read}) {
+        const ObjData obj = read_obj(path, access);
+        CHECK(obj.positions.size() == 3 * count);
+        CHECK(obj.indices.size() == 3 * (count - 1));
+        bool ordered = true;
+        for (size_t i = 0; i < count; i++) {
+            ordered = ordered && obj.positions[3 * i] == static_cast<float>(i);
+        }
+        for (size_t f = 0; f + 1 < count; f++) {
+            ordered = ordered && obj.indices[3 * f] == f && obj.indices[3 * f + 1] == f + 1 &&
+                      obj.indices[3 * f + 2] == count - 1;
+        }
+        CHECK(ordered);
+    }
+}
+
+void test_errors() {
+    const std::string square{SQUARE};
+    CHECK_THROWS(read_obj(write_obj("zero_index", square + "f 0 1 2\n")));
+    CHECK_THROWS(read_obj(write_obj("past_end", square + "f 1 2 5\n")));
+    CHECK_THROWS(read_obj(write_obj("before_start", square + "f 1 2 -5\n")));
+    CHECK_THROWS(read_obj(write_obj("overflow", square + "f 1 2 99999999999999999999999\n")));
+    CHECK_THROWS(read_obj(write_obj("malformed_index", square + "f 1 2 x\n")));
+    CHECK_THROWS(read_obj(write_obj("short_vertex", "v 0 0\n")));
+    CHECK_THROWS(read_obj(write_obj("malformed_number", "v 0 x 1\n")));
+    CHECK_THROWS(read_obj(
+        (fs::temp_directory_path() / "objreader_test_missing.obj").string()));
+}
+} // namespace
+
+void test_objreader() {
+    test_faces();
+    test_colors();
+    test_shapes();
+    test_chunks();
+    test_errors();
+}
@@ -0,0 +1,94 @@
+#include <cstdint>
+#include <vector>
+
+#include "check.hpp"
+#include "occlusion.hpp"
+#include "threadpool.hpp"
+
+namespace {
+// Square of size x size cells at depth z in clip space, covering x in [x0, x1] and y in [-1, 1]
+Occluder make_grid(float x0, float x1, float z, std::uint32_t size) {
+    Occluder occluder;
+    for (std::uint32_t j = 0; j <= size; j++) {
+        for (std::uint32_t i = 0; i <= size; i++) {
+            occluder.positions.push_back(x0 + (x1 - x0) * static_cast<float>(i) / size);
+            occluder.positions.push_back(-1.0f + 2.0f * static_cast<float>(j) / size);
+            occluder.positions.push_back(z);
+        }
+    }
+    for (std::uint32_t j = 0; j < size; j++) {
+        for (std::uint32_t i = 0; i < size; i++) {
+            const std::uint32_t v = j * (size + 1) + i;
+            occluder.indices.insert(occluder.indices.end(),
+                                    {v, v + 1, v + size + 2, v, v + size + 2, v + size + 1});
+        }
+    }
+    return occluder;
+}
+
+Bounds make_box(float x0, float x1, float z0, float z1) {
+    return Bounds{{x0, -0.5f, z0}, {x1, 0.5f, z1}};
+}
+
+void test_make_occluder() {
+    const std::vector<float> positions{0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3};
+    const Occluder occluder = make_occluder({3, 1, 3}, positions.data());
+    // Only the used vertices are kept, in order of first use
+    CHECK((occluder.positions == std::vector<float>{3, 3, 3, 1, 1, 1}));
+    CHECK((occluder.indices == std::vector<std::uint32_t>{0, 1, 0}));
+}
+
+void test_culling() {
+    // The identity maps clip space onto the buffer, with window depth (z + 1) / 2
+    const Matrix4 identity;
+    OcclusionBuffer buffer{62, 32};
+    CHECK(buffer.width() == 64 && buffer.height() == 32);
+    CHECK(buffer.depth(10, 10) == 1.0f);
+
+    // Occluder over the left half of the buffer, at window depth 0.5
+    buffer.rasterize(make_grid(-1.0f, 0.0f, 0.0f, 1), {identity});
+    buffer.build_pyramid();
+    CHECK(buffer.depth(8, 16) == 0.5f);
+    CHECK(buffer.depth(56, 16) == 1.0f);
+
+    CHECK(buffer.box_visible(make_box(-0.8f, -0.2f, 0.2f, 0.6f), identity) == false);
+    CHECK(buffer.box_visible(make_box(-0.8f, -0.2f, -0.6f, -0.2f), identity));
+    CHECK(buffer.box_visible(make_box(0.2f, 0.8f, 0.2f, 0.6f), identity));
+    // Partly in front of the occluder
+    CHECK(buffer.box_visible(make_box(-0.8f, -0.2f, -0.2f, 0.6f), identity));
+
+    buffer.clear();
+    buffer.build_pyramid();
+    CHECK(buffer.depth(8, 16) == 1.0f);
+    CHECK(buffer.box_visible(make_box(-0.8f, -0.2f, 0.2f, 0.6f), identity));
+}
+
+// Occluders large enough to be split into bands of rows draw the same depth on a pool
+void test_pool() {
+    Matrix4 tilted;
+    tilted[8] = 0.25f;
+    const std::vector<Matrix4> mvps{Matrix4{}, tilted};
+    const Occluder occluder = make_grid(-0.9f, 0.7f, 0.1f, 64);
+
+    OcclusionBuffer serial{320, 180};
+    serial.rasterize(occluder, mvps);
+    ThreadPool pool{4};
+    OcclusionBuffer parallel{320, 180, &pool};
+    parallel.rasterize(occluder, mvps);
+
+    bool same = true;
+    for (size_t y = 0; y < serial.height(); y++) {
+        for (size_t x = 0; x < serial.width(); x++) {
+            same = same && serial.depth(x, y) == parallel.depth(x, y);
+        }
+    }
+    CHECK(same);
+    CHECK(parallel.depth(40, 90) < 1.0f && parallel.depth(300, 90) == 1.0f);
+}
+} // namespace
+
+void test_occlusion() {
+    test_make_occluder();
+    test_culling();
+    test_pool();
+}